@@ -0,0 +1,32 @@
+#!/bin/sh
+#
+# Access log check: replay the corpus pipelined and fragmented, every
+# request must be logged once with the request line taken from the
+# corpus (i.e. parser spans still valid after the buffer compaction).
+
+PORT=18099
+REQUESTS=20000
+LOG=$(mktemp)
+
+cd "$(dirname "$0")" || exit 1
+
+./mk_bench_server -p $PORT -w 2 -l "$LOG" > /dev/null &
+SERVER=$!
+sleep 0.5
+
+./mk_bench_load -p $PORT -c 8 -n $REQUESTS -P 4 -f 16 corpus.txt > /dev/null
+RET=$?
+
+# pending records are written after one second idle
+sleep 1.5
+kill $SERVER
+
+LINES=$(wc -l < "$LOG")
+BAD=$(grep -cvE '^[0-9]+ "localhost" "(GET|POST) /[^ ]* HTTP/1\.1" 200 [0-9]+ ' "$LOG")
+rm -f "$LOG"
+
+if [ $RET -ne 0 ] || [ "$LINES" -ne $REQUESTS ] || [ "$BAD" -ne 0 ]; then
+    echo "access log check: FAIL ($LINES records, $BAD invalid)"
+    exit 1
+fi
+echo "access log check: OK ($LINES records)"
@@ -0,0 +1,544 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Monkey HTTP Server
+ *  ==================
+ *  Copyright 2001-2014 Monkey Software LLC <eduardo@monkey.io>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+/*
+ * Load generator: replay a requests corpus over loopback keep-alive
+ * connections. Every connection sends a batch of 'pipeline' requests
+ * written in fragments of 'frag' bytes, then waits for all responses.
+ * The latency of each request is measured from the batch write until
+ * its response is complete.
+ *
+ * Corpus format: requests separated by a line with '%%', the headers
+ * lines end with LF and are converted to CRLF, the body (if any) is
+ * sent as is and framed by its Content-Length: the LF ending the body
+ * line before the separator is not part of it.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+
+#define CONN_BUF       65536
+#define PIPELINE_MAX     256
+#define EPOLL_EVENTS     256
+
+struct corpus_entry {
+    int len;
+    char *data;
+};
+
+struct conn {
+    int fd;
+    int next;             /* next corpus entry                */
+    int batch;            /* requests in the current batch    */
+    int done;             /* responses received in the batch  */
+    int out_len;
+    int out_sent;
+    int in_len;
+    long start;           /* batch start time (ns)            */
+    char out[CONN_BUF];
+    char in[CONN_BUF];
+};
+
+struct worker {
+    pthread_t tid;
+    int conns;
+    long requests;        /* requests to complete             */
+    long completed;
+    long errors;
+    long *latency;        /* ns per request                   */
+};
+
+struct config {
+    int port;
+    int conns;
+    int threads;
+    int frag;
+    int pipeline;
+    long requests;
+    char *corpus;
+};
+
+static struct config config = {
+    .port     = 8080,
+    .conns    = 16,
+    .threads  = 1,
+    .frag     = 0,
+    .pipeline = 1,
+    .requests = 100000,
+    .corpus   = NULL
+};
+
+static int corpus_size;
+static struct corpus_entry *corpus;
+
+static char default_request[] =
+    "GET /index.html HTTP/1.1\n"
+    "Host: localhost\n"
+    "User-Agent: mk_bench_load\n"
+    "Accept: */*\n"
+    "\n";
+
+static inline long now_ns()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+/*
+ * Register a corpus entry converting the headers block to CRLF. Returns
+ * -1 if the body does not match the Content-Length header.
+ */
+static int corpus_add(char *req, int len)
+{
+    int i;
+    int n = 0;
+    int body = -1;
+    long clen = 0;
+    char *buf;
+    struct corpus_entry *e;
+
+    buf = malloc(len * 2 + 1);
+    for (i = 0; i < len; i++) {
+        if (req[i] == '\n') {
+            buf[n++] = '\r';
+            buf[n++] = '\n';
+            if (i > 0 && req[i - 1] == '\n') {
+                body = i + 1;
+                break;
+            }
+            if (strncasecmp(req + i + 1, "Content-Length:", 15) == 0) {
+                clen = strtol(req + i + 16, NULL, 10);
+            }
+            continue;
+        }
+        buf[n++] = req[i];
+    }
+
+    if (body == -1) {
+        free(buf);
+        return -1;
+    }
+
+    /* drop the line end before the separator */
+    if (len - body == clen + 1 && req[len - 1] == '\n') {
+        len--;
+    }
+    if (len - body != clen) {
+        free(buf);
+        return -1;
+    }
+    memcpy(buf + n, req + body, clen);
+    n += clen;
+
+    corpus = realloc(corpus, sizeof(struct corpus_entry) * (corpus_size + 1));
+    e = &corpus[corpus_size++];
+    e->data = buf;
+    e->len  = n;
+    return 0;
+}
+
+static int corpus_load(char *path)
+{
+    long size;
+    char *p;
+    char *end;
+    char *sep;
+    char *data;
+    FILE *f;
+
+    if (!path) {
+        return corpus_add(default_request, sizeof(default_request) - 1);
+    }
+
+    f = fopen(path, "r");
+    if (!f) {
+        perror("fopen");
+        return -1;
+    }
+    fseek(f, 0, SEEK_END);
+    size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    data = malloc(size + 1);
+    if (fread(data, 1, size, f) != size) {
+        fclose(f);
+        free(data);
+        return -1;
+    }
+    fclose(f);
+    data[size] = '\0';
+
+    p   = data;
+    end = data + size;
+    while (p < end) {
+        sep = strstr(p, "\n%%\n");
+        if (!sep) {
+            sep = end;
+        }
+        else {
+            sep++;
+        }
+
+        if (sep > p && corpus_add(p, sep - p) != 0) {
+            fprintf(stderr, "corpus: invalid request #%i (headers end or "
+                    "Content-Length)\n", corpus_size + 1);
+            free(data);
+            return -1;
+        }
+        p = (sep == end) ? end : sep + 3;
+    }
+    free(data);
+
+    return (corpus_size > 0) ? 0 : -1;
+}
+
+static int conn_open()
+{
+    int fd;
+    int on = 1;
+    struct sockaddr_in addr;
+
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd == -1) {
+        return -1;
+    }
+
+    memset(&addr, '\0', sizeof(addr));
+    addr.sin_family      = AF_INET;
+    addr.sin_port        = htons(config.port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+    return fd;
+}
+
+/* Prepare the next batch of pipelined requests */
+static void conn_batch(struct conn *c, long pending)
+{
+    int i;
+    struct corpus_entry *e;
+
+    c->batch    = (pending < config.pipeline) ? pending : config.pipeline;
+    c->done     = 0;
+    c->out_len  = 0;
+    c->out_sent = 0;
+
+    for (i = 0; i < c->batch; i++) {
+        e = &corpus[c->next];
+        if (c->out_len + e->len > CONN_BUF) {
+            c->batch = i;
+            break;
+        }
+        memcpy(c->out + c->out_len, e->data, e->len);
+        c->out_len += e->len;
+        c->next = (c->next + 1) % corpus_size;
+    }
+    c->start = now_ns();
+}
+
+/* Write the batch, on fragments if it was requested */
+static int conn_send(struct conn *c)
+{
+    int size;
+    ssize_t n;
+
+    while (c->out_sent < c->out_len) {
+        size = c->out_len - c->out_sent;
+        if (config.frag > 0 && size > config.frag) {
+            size = config.frag;
+        }
+
+        n = write(c->fd, c->out + c->out_sent, size);
+        if (n == -1) {
+            return (errno == EAGAIN) ? 0 : -1;
+        }
+        c->out_sent += n;
+    }
+    return 0;
+}
+
+/*
+ * Check if the input buffer starts with a complete response, returns its
+ * length or 0 if more data is needed.
+ */
+static int response_len(char *buf, int len)
+{
+    int hlen;
+    long clen = 0;
+    char *p;
+    char *end;
+
+    end = memmem(buf, len, "\r\n\r\n", 4);
+    if (!end) {
+        return 0;
+    }
+    hlen = (end - buf) + 4;
+
+    for (p = buf; p < end; p++) {
+        if (*p == '\n' && end - p > 16 &&
+            strncasecmp(p + 1, "Content-Length:", 15) == 0) {
+            clen = strtol(p + 16, NULL, 10);
+            break;
+        }
+    }
+
+    if (hlen + clen > len) {
+        return 0;
+    }
+    return hlen + clen;
+}
+
+static void *worker(void *data)
+{
+    int i;
+    int n;
+    int efd;
+    int size;
+    long t;
+    long sent = 0;
+    ssize_t bytes;
+    struct conn *c;
+    struct conn *conns;
+    struct epoll_event ev;
+    struct epoll_event events[EPOLL_EVENTS];
+    struct worker *w = data;
+
+    efd   = epoll_create1(0);
+    conns = calloc(w->conns, sizeof(struct conn));
+
+    for (i = 0; i < w->conns; i++) {
+        c = &conns[i];
+        c->fd = conn_open();
+        if (c->fd == -1) {
+            perror("connect");
+            exit(EXIT_FAILURE);
+        }
+        c->next = (i * 7) % corpus_size;
+
+        conn_batch(c, w->requests - sent);
+        sent += c->batch;
+        conn_send(c);
+
+        ev.events   = EPOLLIN | EPOLLOUT | EPOLLET;
+        ev.data.ptr = c;
+        epoll_ctl(efd, EPOLL_CTL_ADD, c->fd, &ev);
+    }
+
+    while (w->completed + w->errors < w->requests) {
+        n = epoll_wait(efd, events, EPOLL_EVENTS, 1000);
+        if (n == 0) {
+            fprintf(stderr, "mk_bench_load: timeout waiting responses\n");
+            break;
+        }
+
+        for (i = 0; i < n; i++) {
+            c = events[i].data.ptr;
+
+            if (conn_send(c) != 0) {
+                fprintf(stderr, "mk_bench_load: write error\n");
+                exit(EXIT_FAILURE);
+            }
+
+            while (1) {
+                bytes = read(c->fd, c->in + c->in_len, CONN_BUF - c->in_len);
+                if (bytes <= 0) {
+                    if (bytes == 0 || errno != EAGAIN) {
+                        fprintf(stderr, "mk_bench_load: connection closed\n");
+                        exit(EXIT_FAILURE);
+                    }
+                    break;
+                }
+                c->in_len += bytes;
+
+                t = now_ns();
+                while ((size = response_len(c->in, c->in_len)) > 0) {
+                    if (strncmp(c->in + 9, "200", 3) == 0) {
+                        w->latency[w->completed++] = t - c->start;
+                    }
+                    else {
+                        w->errors++;
+                    }
+                    c->done++;
+                    c->in_len -= size;
+                    memmove(c->in, c->in + size, c->in_len);
+                }
+
+                if (c->done == c->batch && sent < w->requests) {
+                    conn_batch(c, w->requests - sent);
+                    sent += c->batch;
+                    conn_send(c);
+                }
+            }
+        }
+    }
+
+    for (i = 0; i < w->conns; i++) {
+        close(conns[i].fd);
+    }
+    free(conns);
+    close(efd);
+
+    return NULL;
+}
+
+static int cmp_long(const void *a, const void *b)
+{
+    long x = *(const long *) a;
+    long y = *(const long *) b;
+
+    return (x > y) - (x < y);
+}
+
+static void usage()
+{
+    printf("Usage: mk_bench_load [options] [corpus_file]\n\n");
+    printf("  -p  server port on 127.0.0.1 (default %i)\n", config.port);
+    printf("  -c  concurrent connections (default %i)\n", config.conns);
+    printf("  -t  threads (default %i)\n", config.threads);
+    printf("  -n  total requests (default %li)\n", config.requests);
+    printf("  -P  pipelining depth (default %i)\n", config.pipeline);
+    printf("  -f  write fragment size, 0 = no fragmentation (default %i)\n",
+           config.frag);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+    int i;
+    int opt;
+    long t;
+    long n;
+    long total = 0;
+    long errors = 0;
+    long *latency;
+    struct worker *workers;
+    struct worker *w;
+
+    while ((opt = getopt(argc, argv, "p:c:t:n:P:f:")) != -1) {
+        switch (opt) {
+        case 'p':
+            config.port = atoi(optarg);
+            break;
+        case 'c':
+            config.conns = atoi(optarg);
+            break;
+        case 't':
+            config.threads = atoi(optarg);
+            break;
+        case 'n':
+            config.requests = atol(optarg);
+            break;
+        case 'P':
+            config.pipeline = atoi(optarg);
+            break;
+        case 'f':
+            config.frag = atoi(optarg);
+            break;
+        default:
+            usage();
+        };
+    }
+
+    if (optind < argc) {
+        config.corpus = argv[optind];
+    }
+
+    if (config.threads < 1 || config.conns < config.threads ||
+        config.requests < config.conns || config.pipeline < 1 ||
+        config.pipeline > PIPELINE_MAX || config.frag < 0) {
+        usage();
+    }
+
+    if (corpus_load(config.corpus) != 0) {
+        fprintf(stderr, "mk_bench_load: invalid corpus\n");
+        exit(EXIT_FAILURE);
+    }
+
+    /* Connections and requests are spread among threads */
+    workers = calloc(config.threads, sizeof(struct worker));
+    for (i = 0; i < config.threads; i++) {
+        w = &workers[i];
+        w->conns    = config.conns / config.threads +
+            (i < config.conns % config.threads);
+        w->requests = config.requests / config.threads +
+            (i < config.requests % config.threads);
+        w->latency  = malloc(sizeof(long) * w->requests);
+    }
+
+    t = now_ns();
+    for (i = 0; i < config.threads; i++) {
+        pthread_create(&workers[i].tid, NULL, worker, &workers[i]);
+    }
+    for (i = 0; i < config.threads; i++) {
+        pthread_join(workers[i].tid, NULL);
+    }
+    t = now_ns() - t;
+
+    /* Merge latencies */
+    latency = malloc(sizeof(long) * config.requests);
+    for (i = 0; i < config.threads; i++) {
+        w = &workers[i];
+        memcpy(latency + total, w->latency, sizeof(long) * w->completed);
+        total  += w->completed;
+        errors += w->errors;
+    }
+
+    if (total == 0) {
+        fprintf(stderr, "mk_bench_load: no requests completed\n");
+        exit(EXIT_FAILURE);
+    }
+    qsort(latency, total, sizeof(long), cmp_long);
+
+    n = total - 1;
+    printf("requests    : %li (%li errors)\n", total, errors);
+    printf("connections : %i, threads %i, pipeline %i, fragment %i\n",
+           config.conns, config.threads, config.pipeline, config.frag);
+    printf("elapsed     : %.3f s\n", t / 1e9);
+    printf("throughput  : %.0f req/s\n", total / (t / 1e9));
+    printf("latency us  : p50 %.1f  p99 %.1f  p999 %.1f  max %.1f\n",
+           latency[n * 50 / 100] / 1e3,
+           latency[n * 99 / 100] / 1e3,
+           latency[n * 999 / 1000] / 1e3,
+           latency[n] / 1e3);
+
+    return (errors > 0) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
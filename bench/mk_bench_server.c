@@ -0,0 +1,386 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Monkey HTTP Server
+ *  ==================
+ *  Copyright 2001-2014 Monkey Software LLC <eduardo@monkey.io>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+/*
+ * Reference server: every worker thread owns a listener socket (bound
+ * with SO_REUSEPORT) and an epoll loop. Each connection is parsed with
+ * mk_http_parser() and answered with a fixed response, keep-alive and
+ * pipelined requests are supported. With -l every worker writes its own
+ * access log ring to the given file.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+
+#include "../mk_http_parser.h"
+#include "../mk_http_log.h"
+
+#define CONN_BUF       65536
+#define CONN_OUT       65536
+#define EPOLL_EVENTS   256
+#define LOG_RING       (1024 * 1024)
+
+static char response_ok[] =
+    "HTTP/1.1 200 OK\r\n"
+    "Content-Length: 2\r\n"
+    "\r\n"
+    "OK";
+
+static char response_error[] =
+    "HTTP/1.1 400 Bad Request\r\n"
+    "Content-Length: 0\r\n"
+    "Connection: close\r\n"
+    "\r\n";
+
+struct conn {
+    int fd;
+    int len;        /* bytes in buffer                          */
+    int off;        /* current request offset                   */
+    int fed;        /* bytes of the current request parsed      */
+    int out_len;
+    int out_sent;
+    int close;
+    struct mk_http_parser req;
+    char buf[CONN_BUF];
+    char out[CONN_OUT];
+};
+
+struct config {
+    int port;
+    int workers;
+    int log_fd;
+    int log_format;
+};
+
+static struct config config = {
+    .port       = 8080,
+    .workers    = 1,
+    .log_fd     = -1,
+    .log_format = MK_LOG_TEXT
+};
+
+static __thread struct mk_http_log *access_log;
+
+static int socket_nonblock(int fd)
+{
+    return fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+}
+
+static int server_listen(int port)
+{
+    int fd;
+    int on = 1;
+    struct sockaddr_in addr;
+
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd == -1) {
+        perror("socket");
+        return -1;
+    }
+
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on));
+
+    memset(&addr, '\0', sizeof(addr));
+    addr.sin_family      = AF_INET;
+    addr.sin_port        = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0) {
+        perror("bind");
+        close(fd);
+        return -1;
+    }
+
+    if (listen(fd, 1024) != 0) {
+        perror("listen");
+        close(fd);
+        return -1;
+    }
+
+    socket_nonblock(fd);
+    return fd;
+}
+
+static int conn_flush(struct conn *c)
+{
+    ssize_t n;
+
+    while (c->out_sent < c->out_len) {
+        n = write(c->fd, c->out + c->out_sent, c->out_len - c->out_sent);
+        if (n == -1) {
+            if (errno == EAGAIN) {
+                return 0;
+            }
+            return -1;
+        }
+        c->out_sent += n;
+    }
+
+    c->out_len  = 0;
+    c->out_sent = 0;
+    return 0;
+}
+
+static void conn_reply(struct conn *c, char *buf, int len)
+{
+    if (c->out_len + len > CONN_OUT) {
+        conn_flush(c);
+    }
+    if (c->out_len + len <= CONN_OUT) {
+        memcpy(c->out + c->out_len, buf, len);
+        c->out_len += len;
+    }
+}
+
+/* Parse every complete request available in the connection buffer */
+static int conn_process(struct conn *c)
+{
+    int ret;
+    int size;
+
+    while (c->off < c->len) {
+        ret = mk_http_parser(&c->req, c->buf + c->off,
+                             c->len - c->off - c->fed);
+        c->fed = c->len - c->off;
+
+        if (ret == MK_HTTP_PENDING) {
+            break;
+        }
+        else if (ret == MK_HTTP_ERROR || ret == MK_HTTP_H2_PREFACE) {
+            conn_reply(c, response_error, sizeof(response_error) - 1);
+            c->close = 1;
+            return 0;
+        }
+
+        /* An h2c upgrade is ignored, the request is served as HTTP/1.1 */
+
+        /* The request ends on the body start plus the body */
+        size = c->req.body_start;
+        if (c->req.header_content_length > 0) {
+            size += c->req.header_content_length;
+        }
+
+        conn_reply(c, response_ok, sizeof(response_ok) - 1);
+        if (access_log) {
+            mk_http_log_request(access_log, &c->req, time(NULL), 200,
+                                sizeof(response_ok) - 1);
+        }
+        c->off += size;
+        c->fed  = 0;
+        mk_http_parser_init(&c->req);
+    }
+
+    /*
+     * Move the incomplete request to the buffer start, the parser spans
+     * point to the old place so it's parsed again from the new one.
+     */
+    if (c->off > 0) {
+        memmove(c->buf, c->buf + c->off, c->len - c->off);
+        c->len -= c->off;
+        c->off  = 0;
+        c->fed  = 0;
+        mk_http_parser_init(&c->req);
+    }
+
+    if (c->len == CONN_BUF) {
+        conn_reply(c, response_error, sizeof(response_error) - 1);
+        c->close = 1;
+    }
+    return 0;
+}
+
+static void conn_close(int efd, struct conn *c)
+{
+    epoll_ctl(efd, EPOLL_CTL_DEL, c->fd, NULL);
+    close(c->fd);
+    free(c);
+}
+
+static void conn_accept(int efd, int lfd)
+{
+    int fd;
+    int on = 1;
+    struct conn *c;
+    struct epoll_event ev;
+
+    while ((fd = accept4(lfd, NULL, NULL, SOCK_NONBLOCK)) != -1) {
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+        c = malloc(sizeof(struct conn));
+        if (!c) {
+            close(fd);
+            continue;
+        }
+        c->fd       = fd;
+        c->len      = 0;
+        c->off      = 0;
+        c->fed      = 0;
+        c->out_len  = 0;
+        c->out_sent = 0;
+        c->close    = 0;
+        mk_http_parser_init(&c->req);
+
+        ev.events   = EPOLLIN | EPOLLOUT | EPOLLET | EPOLLRDHUP;
+        ev.data.ptr = c;
+        epoll_ctl(efd, EPOLL_CTL_ADD, fd, &ev);
+    }
+}
+
+static void *worker(void *data)
+{
+    int i;
+    int n;
+    int efd;
+    int lfd;
+    ssize_t bytes;
+    struct conn *c;
+    struct epoll_event ev;
+    struct epoll_event events[EPOLL_EVENTS];
+
+    (void) data;
+
+    lfd = server_listen(config.port);
+    if (lfd == -1) {
+        exit(EXIT_FAILURE);
+    }
+
+    if (config.log_fd != -1) {
+        access_log = mk_http_log_create(config.log_fd, config.log_format,
+                                        LOG_RING);
+    }
+
+    efd = epoll_create1(0);
+    ev.events   = EPOLLIN;
+    ev.data.ptr = NULL;
+    epoll_ctl(efd, EPOLL_CTL_ADD, lfd, &ev);
+
+    while (1) {
+        /* pending log records are written once the worker is idle */
+        n = epoll_wait(efd, events, EPOLL_EVENTS, access_log ? 1000 : -1);
+        if (n == 0 && access_log) {
+            mk_http_log_flush(access_log);
+        }
+        for (i = 0; i < n; i++) {
+            c = events[i].data.ptr;
+            if (!c) {
+                conn_accept(efd, lfd);
+                continue;
+            }
+
+            if (events[i].events & EPOLLIN) {
+                while (c->len < CONN_BUF) {
+                    bytes = read(c->fd, c->buf + c->len, CONN_BUF - c->len);
+                    if (bytes > 0) {
+                        c->len += bytes;
+                        conn_process(c);
+                        continue;
+                    }
+                    if (bytes == 0 || errno != EAGAIN) {
+                        c->close = 1;
+                    }
+                    break;
+                }
+            }
+
+            if (conn_flush(c) != 0 || (c->close && c->out_len == 0)) {
+                conn_close(efd, c);
+            }
+        }
+    }
+
+    return NULL;
+}
+
+static void usage()
+{
+    printf("Usage: mk_bench_server [-p port] [-w workers] [-l file] [-j]\n\n");
+    printf("  -p  listener port on 127.0.0.1 (default %i)\n", config.port);
+    printf("  -w  worker threads, one epoll loop each (default %i)\n",
+           config.workers);
+    printf("  -l  access log file, records are flushed in batches\n");
+    printf("  -j  write the access log records as JSON lines\n");
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+    int i;
+    int opt;
+    pthread_t *tids;
+
+    while ((opt = getopt(argc, argv, "p:w:l:j")) != -1) {
+        switch (opt) {
+        case 'p':
+            config.port = atoi(optarg);
+            break;
+        case 'w':
+            config.workers = atoi(optarg);
+            break;
+        case 'l':
+            config.log_fd = open(optarg, O_WRONLY | O_CREAT | O_APPEND, 0644);
+            if (config.log_fd == -1) {
+                perror("open");
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'j':
+            config.log_format = MK_LOG_JSON;
+            break;
+        default:
+            usage();
+        };
+    }
+
+    if (config.workers < 1) {
+        usage();
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+
+    tids = malloc(sizeof(pthread_t) * config.workers);
+    for (i = 0; i < config.workers; i++) {
+        pthread_create(&tids[i], NULL, worker, NULL);
+    }
+
+    printf("mk_bench_server: listening on 127.0.0.1:%i, %i worker(s)\n",
+           config.port, config.workers);
+    fflush(stdout);
+
+    for (i = 0; i < config.workers; i++) {
+        pthread_join(tids[i], NULL);
+    }
+
+    return 0;
+}
@@ -0,0 +1,353 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Monkey HTTP Server
+ *  ==================
+ *  Copyright 2001-2014 Monkey Software LLC <eduardo@monkey.io>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "mk_http_accept.h"
+
+#define is_lws(c)  (c == ' ' || c == '\t')
+
+struct accept_entry {
+    int id;
+    int len;
+    const char name[24];
+};
+
+struct accept_entry codings_table[] = {
+    { MK_CODING_BR      , 2, "br"       },
+    { MK_CODING_ZSTD    , 4, "zstd"     },
+    { MK_CODING_GZIP    , 4, "gzip"     },
+    { MK_CODING_GZIP    , 6, "x-gzip"   },
+    { MK_CODING_DEFLATE , 7, "deflate"  },
+    { MK_CODING_IDENTITY, 8, "identity" }
+};
+
+struct accept_entry media_table[] = {
+    { MK_MEDIA_HTML ,  9, "text/html"        },
+    { MK_MEDIA_JSON , 16, "application/json" },
+    { MK_MEDIA_PLAIN, 10, "text/plain"       },
+    { MK_MEDIA_XML  , 15, "application/xml"  },
+    { MK_MEDIA_XML  ,  8, "text/xml"         }
+};
+
+#define table_size(t)  (sizeof(t) / sizeof(struct accept_entry))
+
+/*
+ * Per thread cache of computed values, keyed by the raw header value. It's
+ * direct mapped: a collision just replace the old entry.
+ */
+struct accept_cache {
+    unsigned int hash;
+    int len;
+    char key[MK_ACCEPT_CACHE_KEY];
+    struct mk_http_accept acc;
+};
+
+static __thread struct accept_cache encoding_cache[MK_ACCEPT_CACHE_SIZE];
+static __thread struct accept_cache media_cache[MK_ACCEPT_CACHE_SIZE];
+
+/* Convert a q-value to thousandths, returns -1 if is invalid */
+static int accept_qvalue(char *p, char *end)
+{
+    int i;
+    int q;
+
+    if (p >= end || (*p != '0' && *p != '1')) {
+        return -1;
+    }
+
+    q = (*p++ - '0') * 1000;
+    if (p < end && *p == '.') {
+        p++;
+        for (i = 100; i > 0 && p < end && *p >= '0' && *p <= '9'; i /= 10) {
+            q += (*p++ - '0') * i;
+        }
+    }
+
+    if (p != end || q > 1000) {
+        return -1;
+    }
+    return q;
+}
+
+/*
+ * Get the next element of a comma separated list: its name and q-value, other
+ * parameters are ignored. Returns -1 when the list ends.
+ */
+static int accept_next(char **ptr, char *end, mk_ptr_t *name, int *q)
+{
+    char *p;
+    char *e;
+    char *item;
+    char *param;
+
+    while (*ptr < end) {
+        item = *ptr;
+        e = memchr(item, ',', end - item);
+        if (!e) {
+            e = end;
+        }
+        *ptr = e + 1;
+
+        while (item < e && is_lws(*item)) {
+            item++;
+        }
+
+        /* name */
+        p = item;
+        while (p < e && *p != ';' && !is_lws(*p)) {
+            p++;
+        }
+        if (p == item) {
+            continue;
+        }
+        name->data = item;
+        name->len  = p - item;
+        *q = 1000;
+
+        /* parameters */
+        while ((p = memchr(p, ';', e - p)) != NULL) {
+            p++;
+            while (p < e && is_lws(*p)) {
+                p++;
+            }
+            param = p;
+            while (p < e && *p != ';' && !is_lws(*p)) {
+                p++;
+            }
+            if (p - param > 2 && (*param == 'q' || *param == 'Q') &&
+                param[1] == '=') {
+                *q = accept_qvalue(param + 2, p);
+            }
+        }
+
+        if (*q >= 0) {
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+static void accept_mask(struct mk_http_accept *acc, int size)
+{
+    int i;
+
+    acc->mask = 0;
+    for (i = 0; i < size; i++) {
+        if (acc->q[i] > 0) {
+            acc->mask |= MK_ACCEPT_BIT(i);
+        }
+    }
+}
+
+static void accept_encoding_parse(mk_ptr_t *val, struct mk_http_accept *acc)
+{
+    int i;
+    int q;
+    int star = -1;
+    char *p;
+    unsigned int found = 0;
+    mk_ptr_t name;
+    struct accept_entry *e;
+
+    memset(acc, '\0', sizeof(struct mk_http_accept));
+
+    p = val->data;
+    while (accept_next(&p, val->data + val->len, &name, &q) == 0) {
+        if (name.len == 1 && *name.data == '*') {
+            star = q;
+            continue;
+        }
+
+        for (i = 0; i < table_size(codings_table); i++) {
+            e = &codings_table[i];
+            if (e->len == name.len &&
+                strncasecmp(e->name, name.data, name.len) == 0) {
+                if (!(found & MK_ACCEPT_BIT(e->id))) {
+                    found |= MK_ACCEPT_BIT(e->id);
+                    acc->q[e->id] = q;
+                }
+                break;
+            }
+        }
+    }
+
+    /*
+     * Codings not listed takes the '*' q-value. Identity is acceptable
+     * unless it's excluded, but with the lowest preference.
+     */
+    for (i = 0; i < MK_CODING_SIZEOF; i++) {
+        if (found & MK_ACCEPT_BIT(i)) {
+            continue;
+        }
+        if (star >= 0) {
+            acc->q[i] = star;
+        }
+        else if (i == MK_CODING_IDENTITY) {
+            acc->q[i] = 1;
+        }
+    }
+
+    accept_mask(acc, MK_CODING_SIZEOF);
+}
+
+static void accept_media_parse(mk_ptr_t *val, struct mk_http_accept *acc)
+{
+    int i;
+    int q;
+    int level;
+    int spec[MK_MEDIA_SIZEOF];
+    char *p;
+    mk_ptr_t name;
+    struct accept_entry *e;
+
+    memset(acc, '\0', sizeof(struct mk_http_accept));
+    memset(spec, '\0', sizeof(spec));
+
+    p = val->data;
+    while (accept_next(&p, val->data + val->len, &name, &q) == 0) {
+        /*
+         * The most specific media range wins: type/subtype, type/ and
+         * finally the full wildcard.
+         */
+        for (i = 0; i < table_size(media_table); i++) {
+            e = &media_table[i];
+
+            if (name.len == 3 && strncmp(name.data, "*/*", 3) == 0) {
+                level = 1;
+            }
+            else if (name.len >= 2 && name.data[name.len - 1] == '*' &&
+                     name.data[name.len - 2] == '/' &&
+                     strncasecmp(e->name, name.data, name.len - 1) == 0) {
+                level = 2;
+            }
+            else if (e->len == name.len &&
+                     strncasecmp(e->name, name.data, name.len) == 0) {
+                level = 3;
+            }
+            else {
+                continue;
+            }
+
+            if (level > spec[e->id]) {
+                spec[e->id] = level;
+                acc->q[e->id] = q;
+            }
+        }
+    }
+
+    accept_mask(acc, MK_MEDIA_SIZEOF);
+}
+
+static void accept_cached(struct accept_cache *cache, mk_ptr_t *val,
+                          struct mk_http_accept *acc,
+                          void (*parse)(mk_ptr_t *, struct mk_http_accept *))
+{
+    unsigned int h;
+    struct accept_cache *entry;
+
+    h = mk_http_hash(MK_HTTP_HASH_INIT, val->data, val->len);
+    entry = &cache[h & (MK_ACCEPT_CACHE_SIZE - 1)];
+
+    if (entry->hash == h && entry->len == val->len &&
+        memcmp(entry->key, val->data, val->len) == 0) {
+        *acc = entry->acc;
+        return;
+    }
+
+    parse(val, acc);
+    if (val->len <= MK_ACCEPT_CACHE_KEY) {
+        entry->hash = h;
+        entry->len  = val->len;
+        memcpy(entry->key, val->data, val->len);
+        entry->acc  = *acc;
+    }
+}
+
+/*
+ * Compute the Accept-Encoding representation of a request. Without the
+ * header only identity is accepted.
+ */
+int mk_http_accept_encoding(struct mk_http_parser *req,
+                            struct mk_http_accept *acc)
+{
+    struct mk_http_header *header;
+
+    header = &req->headers[MK_HEADER_ACCEPT_ENCODING];
+    if (header->type != MK_HEADER_ACCEPT_ENCODING) {
+        memset(acc, '\0', sizeof(struct mk_http_accept));
+        acc->q[MK_CODING_IDENTITY] = 1000;
+        acc->mask = MK_ACCEPT_BIT(MK_CODING_IDENTITY);
+        return 0;
+    }
+
+    accept_cached(encoding_cache, &header->val, acc, accept_encoding_parse);
+    return 0;
+}
+
+/*
+ * Compute the Accept representation of a request. Without the header any
+ * media type is accepted.
+ */
+int mk_http_accept_media(struct mk_http_parser *req,
+                         struct mk_http_accept *acc)
+{
+    int i;
+    struct mk_http_header *header;
+
+    header = &req->headers[MK_HEADER_ACCEPT];
+    if (header->type != MK_HEADER_ACCEPT) {
+        memset(acc, '\0', sizeof(struct mk_http_accept));
+        for (i = 0; i < MK_MEDIA_SIZEOF; i++) {
+            acc->q[i] = 1000;
+        }
+        accept_mask(acc, MK_MEDIA_SIZEOF);
+        return 0;
+    }
+
+    accept_cached(media_cache, &header->val, acc, accept_media_parse);
+    return 0;
+}
+
+/*
+ * From the 'supported' set of items (MK_ACCEPT_BIT() mask), return the one
+ * with the highest q-value, ties are resolved by the enum order. Returns -1
+ * if none of them is acceptable.
+ */
+int mk_http_accept_best(struct mk_http_accept *acc, unsigned int supported)
+{
+    int id;
+    int best = -1;
+    unsigned int set;
+
+    set = acc->mask & supported;
+    while (set) {
+        id = __builtin_ctz(set);
+        set &= set - 1;
+        if (best == -1 || acc->q[id] > acc->q[best]) {
+            best = id;
+        }
+    }
+
+    return best;
+}
@@ -0,0 +1,67 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Monkey HTTP Server
+ *  ==================
+ *  Copyright 2001-2014 Monkey Software LLC <eduardo@monkey.io>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include "mk_http_parser.h"
+
+#ifndef MK_HTTP_ACCEPT_H
+#define MK_HTTP_ACCEPT_H
+
+/*
+ * Content codings known by Accept-Encoding, the order is the server
+ * preference used to break ties between equal q-values.
+ */
+enum {
+    MK_CODING_BR       = 0,
+    MK_CODING_ZSTD        ,
+    MK_CODING_GZIP        ,
+    MK_CODING_DEFLATE     ,
+    MK_CODING_IDENTITY    ,
+    MK_CODING_SIZEOF
+};
+
+/* Media types known by Accept, same rules for ties than codings */
+enum {
+    MK_MEDIA_HTML      = 0,
+    MK_MEDIA_JSON         ,
+    MK_MEDIA_PLAIN        ,
+    MK_MEDIA_XML          ,
+    MK_MEDIA_SIZEOF
+};
+
+#define MK_ACCEPT_BIT(id)      (1u << (id))
+#define MK_ACCEPT_CACHE_SIZE   256    /* per thread entries, power of 2 */
+#define MK_ACCEPT_CACHE_KEY     96    /* longer values are not cached   */
+
+/*
+ * Compact representation of an Accept-* header: 'mask' have a bit set for
+ * every acceptable item (q > 0), and 'q' holds the q-value of each item
+ * in thousandths (the maximum precision allowed by the grammar).
+ */
+struct mk_http_accept {
+    unsigned int mask;
+    unsigned short q[8];
+};
+
+int mk_http_accept_encoding(struct mk_http_parser *req,
+                            struct mk_http_accept *acc);
+int mk_http_accept_media(struct mk_http_parser *req,
+                         struct mk_http_accept *acc);
+int mk_http_accept_best(struct mk_http_accept *acc, unsigned int supported);
+
+#endif /* MK_HTTP_ACCEPT_H */
@@ -0,0 +1,198 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Monkey HTTP Server
+ *  ==================
+ *  Copyright 2001-2014 Monkey Software LLC <eduardo@monkey.io>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mk_http_cookie.h"
+
+#define is_lws(c)  (c == ' ' || c == '\t')
+
+int mk_http_cookie_iter_init(struct mk_http_cookie_iter *it,
+                             struct mk_http_parser *req)
+{
+    struct mk_http_header *header;
+
+    header = &req->headers[MK_HEADER_COOKIE];
+    if (header->type != MK_HEADER_COOKIE) {
+        it->p   = NULL;
+        it->end = NULL;
+        return -1;
+    }
+
+    it->p   = header->val.data;
+    it->end = header->val.data + header->val.len;
+    return 0;
+}
+
+/*
+ * Get the next cookie pair, returns 0 on success or -1 when there are no
+ * more cookies. Empty pairs are skipped and a pair without '=' is
+ * reported with an empty value.
+ */
+int mk_http_cookie_next(struct mk_http_cookie_iter *it,
+                        struct mk_http_cookie *cookie)
+{
+    char *p;
+    char *eq;
+    char *end;
+
+    while (it->p && it->p < it->end) {
+        p = it->p;
+
+        /* the libc memchr() scan the pair end a word (or vector) a time */
+        end = memchr(p, ';', it->end - p);
+        if (!end) {
+            end = it->end;
+            it->p = it->end;
+        }
+        else {
+            it->p = end + 1;
+        }
+
+        /* trim */
+        while (p < end && is_lws(*p)) {
+            p++;
+        }
+        while (end > p && is_lws(end[-1])) {
+            end--;
+        }
+        if (p == end) {
+            continue;
+        }
+
+        eq = memchr(p, '=', end - p);
+        if (!eq) {
+            cookie->name.data = p;
+            cookie->name.len  = end - p;
+            cookie->val.data  = end;
+            cookie->val.len   = 0;
+            return 0;
+        }
+
+        cookie->name.data = p;
+        cookie->name.len  = eq - p;
+        while (cookie->name.len > 0 && is_lws(p[cookie->name.len - 1])) {
+            cookie->name.len--;
+        }
+
+        p = eq + 1;
+        while (p < end && is_lws(*p)) {
+            p++;
+        }
+
+        /* quoted value */
+        if (end - p >= 2 && *p == '"' && end[-1] == '"') {
+            p++;
+            end--;
+        }
+        cookie->val.data = p;
+        cookie->val.len  = end - p;
+        return 0;
+    }
+
+    return -1;
+}
+
+void mk_http_cookie_index_init(struct mk_http_cookie_index *idx,
+                               struct mk_http_parser *req)
+{
+    idx->built = 0;
+    idx->count = 0;
+    idx->req   = req;
+}
+
+static void cookie_index_build(struct mk_http_cookie_index *idx)
+{
+    unsigned int h;
+    unsigned int mask = MK_COOKIE_INDEX_SLOTS - 1;
+    struct mk_http_cookie *c;
+    struct mk_http_cookie *e;
+
+    memset(idx->slots, '\0', sizeof(idx->slots));
+    idx->built = 1;
+    idx->count = 0;
+
+    if (mk_http_cookie_iter_init(&idx->rest, idx->req) != 0) {
+        return;
+    }
+
+    while (idx->count < MK_COOKIE_INDEX_MAX) {
+        c = &idx->cookies[idx->count];
+        if (mk_http_cookie_next(&idx->rest, c) != 0) {
+            break;
+        }
+
+        /* linear probing, the first cookie with a given name wins */
+        h = mk_http_hash(MK_HTTP_HASH_INIT, c->name.data, c->name.len);
+        h &= mask;
+        while (idx->slots[h] != 0) {
+            e = &idx->cookies[idx->slots[h] - 1];
+            if (e->name.len == c->name.len &&
+                memcmp(e->name.data, c->name.data, c->name.len) == 0) {
+                break;
+            }
+            h = (h + 1) & mask;
+        }
+
+        if (idx->slots[h] == 0) {
+            idx->slots[h] = ++idx->count;
+        }
+    }
+}
+
+/*
+ * Lookup a cookie by name, the index is built on the first call. Returns 0
+ * and set 'val' if the cookie exists, otherwise -1.
+ */
+int mk_http_cookie_lookup(struct mk_http_cookie_index *idx,
+                          const char *name, int len, mk_ptr_t *val)
+{
+    unsigned int h;
+    unsigned int mask = MK_COOKIE_INDEX_SLOTS - 1;
+    struct mk_http_cookie *c;
+    struct mk_http_cookie cookie;
+    struct mk_http_cookie_iter it;
+
+    if (!idx->built) {
+        cookie_index_build(idx);
+    }
+
+    h = mk_http_hash(MK_HTTP_HASH_INIT, name, len) & mask;
+    while (idx->slots[h] != 0) {
+        c = &idx->cookies[idx->slots[h] - 1];
+        if (c->name.len == len && memcmp(c->name.data, name, len) == 0) {
+            *val = c->val;
+            return 0;
+        }
+        h = (h + 1) & mask;
+    }
+
+    /* Cookies that did not fit in the index */
+    it = idx->rest;
+    while (mk_http_cookie_next(&it, &cookie) == 0) {
+        if (cookie.name.len == len && memcmp(cookie.name.data, name, len) == 0) {
+            *val = cookie.val;
+            return 0;
+        }
+    }
+
+    return -1;
+}
@@ -0,0 +1,65 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Monkey HTTP Server
+ *  ==================
+ *  Copyright 2001-2014 Monkey Software LLC <eduardo@monkey.io>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include "mk_http_parser.h"
+
+#ifndef MK_HTTP_COOKIE_H
+#define MK_HTTP_COOKIE_H
+
+#define MK_COOKIE_INDEX_MAX     64    /* cookies registered in the index */
+#define MK_COOKIE_INDEX_SLOTS  128    /* hash slots, power of 2          */
+
+/* A cookie name/value pair, both spans points to the request buffer */
+struct mk_http_cookie {
+    mk_ptr_t name;
+    mk_ptr_t val;
+};
+
+/* Iterator over the Cookie header value */
+struct mk_http_cookie_iter {
+    char *p;
+    char *end;
+};
+
+/*
+ * Optional per-request cookie index, it's built on the first lookup and
+ * further lookups are resolved with a hash probe. If the request have
+ * more than MK_COOKIE_INDEX_MAX cookies, the misses fallback to a linear
+ * scan of the remaining ones.
+ */
+struct mk_http_cookie_index {
+    int built;
+    int count;
+    struct mk_http_parser *req;
+    struct mk_http_cookie_iter rest;   /* cookies not indexed */
+    unsigned char slots[MK_COOKIE_INDEX_SLOTS];  /* 1 + cookie position */
+    struct mk_http_cookie cookies[MK_COOKIE_INDEX_MAX];
+};
+
+int mk_http_cookie_iter_init(struct mk_http_cookie_iter *it,
+                             struct mk_http_parser *req);
+int mk_http_cookie_next(struct mk_http_cookie_iter *it,
+                        struct mk_http_cookie *cookie);
+
+void mk_http_cookie_index_init(struct mk_http_cookie_index *idx,
+                               struct mk_http_parser *req);
+int mk_http_cookie_lookup(struct mk_http_cookie_index *idx,
+                          const char *name, int len, mk_ptr_t *val);
+
+#endif /* MK_HTTP_COOKIE_H */
@@ -0,0 +1,216 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Monkey HTTP Server
+ *  ==================
+ *  Copyright 2001-2014 Monkey Software LLC <eduardo@monkey.io>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mk_http_date.h"
+
+/*
+ * Per thread cache of parsed dates keyed by the exact value bytes, clients
+ * send the same few dates again and again.
+ */
+struct date_cache {
+    int len;
+    char key[MK_DATE_CACHE_KEY];
+    time_t t;
+};
+
+static __thread struct date_cache date_cache[MK_DATE_CACHE_SIZE];
+
+static const char months[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+
+#define is_digit(c)  (c >= '0' && c <= '9')
+
+/* Convert 'n' digits, returns -1 if there is something else */
+static inline int date_number(const char *p, int n)
+{
+    int i;
+    int v = 0;
+
+    for (i = 0; i < n; i++) {
+        if (!is_digit(p[i])) {
+            return -1;
+        }
+        v = (v * 10) + (p[i] - '0');
+    }
+    return v;
+}
+
+static inline int date_month(const char *p)
+{
+    int i;
+
+    for (i = 0; i < 12; i++) {
+        if (memcmp(p, months + (i * 3), 3) == 0) {
+            return i + 1;
+        }
+    }
+    return -1;
+}
+
+/* 'HH:MM:SS' to seconds */
+static inline int date_time(const char *p)
+{
+    int h;
+    int m;
+    int s;
+
+    if (p[2] != ':' || p[5] != ':') {
+        return -1;
+    }
+
+    h = date_number(p, 2);
+    m = date_number(p + 3, 2);
+    s = date_number(p + 6, 2);
+    if (h < 0 || h > 23 || m < 0 || m > 59 || s < 0 || s > 60) {
+        return -1;
+    }
+    return (h * 3600) + (m * 60) + s;
+}
+
+/* Days since the epoch of a civil date (proleptic Gregorian calendar) */
+static inline long date_days(int y, int m, int d)
+{
+    long era;
+    long yoe;
+    long doy;
+    long doe;
+
+    y  -= (m <= 2);
+    era = (y >= 0 ? y : y - 399) / 400;
+    yoe = y - era * 400;
+    doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+
+    return era * 146097 + doe - 719468;
+}
+
+static time_t date_build(int y, int m, int d, int secs)
+{
+    static const int mdays[] = {31, 29, 31, 30, 31, 30,
+                                31, 31, 30, 31, 30, 31};
+
+    if (y < 0 || m < 1 || m > 12 || d < 1 || d > mdays[m - 1] || secs < 0) {
+        return -1;
+    }
+    if (m == 2 && d == 29 &&
+        !((y % 4 == 0 && y % 100 != 0) || y % 400 == 0)) {
+        return -1;
+    }
+
+    return (time_t) date_days(y, m, d) * 86400 + secs;
+}
+
+/*
+ * Parse an HTTP date in any of the three formats allowed by RFC 7231:
+ *
+ *   IMF-fixdate : Sun, 06 Nov 1994 08:49:37 GMT
+ *   RFC 850     : Sunday, 06-Nov-94 08:49:37 GMT
+ *   asctime     : Sun Nov  6 08:49:37 1994
+ *
+ * Returns the time or -1 if the value is invalid.
+ */
+time_t mk_http_date_parse(const char *buf, int len)
+{
+    int y;
+    const char *p;
+
+    /* IMF-fixdate */
+    if (len == 29 && buf[3] == ',') {
+        if (buf[4] != ' ' || buf[7] != ' ' || buf[11] != ' ' ||
+            buf[16] != ' ' || buf[25] != ' ' ||
+            memcmp(buf + 26, "GMT", 3) != 0) {
+            return -1;
+        }
+        return date_build(date_number(buf + 12, 4), date_month(buf + 8),
+                          date_number(buf + 5, 2), date_time(buf + 17));
+    }
+
+    /* asctime */
+    if (len == 24 && buf[3] == ' ') {
+        if (buf[7] != ' ' || buf[10] != ' ' || buf[19] != ' ') {
+            return -1;
+        }
+        p = buf + 8;
+        if (*p == ' ') {
+            p++;
+        }
+        return date_build(date_number(buf + 20, 4), date_month(buf + 4),
+                          date_number(p, (buf + 10) - p), date_time(buf + 11));
+    }
+
+    /* RFC 850: the weekday length is variable */
+    p = memchr(buf, ',', len < 10 ? len : 10);
+    if (!p || (buf + len) - p != 24) {
+        return -1;
+    }
+    p += 2;
+    if (p[-1] != ' ' || p[2] != '-' || p[6] != '-' || p[9] != ' ' ||
+        p[18] != ' ' || memcmp(p + 19, "GMT", 3) != 0) {
+        return -1;
+    }
+
+    y = date_number(p + 7, 2);
+    if (y >= 0) {
+        y += (y < 70) ? 2000 : 1900;
+    }
+    return date_build(y, date_month(p + 3), date_number(p, 2),
+                      date_time(p + 10));
+}
+
+/*
+ * Typed accessor for date headers (If-Modified-Since, Last-Modified...),
+ * the value is parsed on demand and cached per thread. Returns 0 and set
+ * 't' if the header exists and it's a valid date, otherwise -1.
+ */
+int mk_http_header_date(struct mk_http_parser *req, int header, time_t *t)
+{
+    int len;
+    unsigned int h;
+    struct date_cache *entry;
+    struct mk_http_header *hdr;
+
+    if (header < 0 || header >= MK_HEADER_SIZEOF) {
+        return -1;
+    }
+
+    hdr = &req->headers[header];
+    if (hdr->type != header) {
+        return -1;
+    }
+
+    len = hdr->val.len;
+    if (len > MK_DATE_CACHE_KEY) {
+        *t = mk_http_date_parse(hdr->val.data, len);
+        return (*t == -1) ? -1 : 0;
+    }
+
+    h = mk_http_hash(MK_HTTP_HASH_INIT, hdr->val.data, len);
+    entry = &date_cache[h & (MK_DATE_CACHE_SIZE - 1)];
+    if (entry->len != len || memcmp(entry->key, hdr->val.data, len) != 0) {
+        entry->len = len;
+        memcpy(entry->key, hdr->val.data, len);
+        entry->t = mk_http_date_parse(hdr->val.data, len);
+    }
+
+    *t = entry->t;
+    return (*t == -1) ? -1 : 0;
+}
@@ -0,0 +1,33 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Monkey HTTP Server
+ *  ==================
+ *  Copyright 2001-2014 Monkey Software LLC <eduardo@monkey.io>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <time.h>
+
+#include "mk_http_parser.h"
+
+#ifndef MK_HTTP_DATE_H
+#define MK_HTTP_DATE_H
+
+#define MK_DATE_CACHE_SIZE   64    /* per thread entries, power of 2 */
+#define MK_DATE_CACHE_KEY    32    /* longer values are not cached   */
+
+time_t mk_http_date_parse(const char *buf, int len);
+int mk_http_header_date(struct mk_http_parser *req, int header, time_t *t);
+
+#endif /* MK_HTTP_DATE_H */
@@ -0,0 +1,153 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Monkey HTTP Server
+ *  ==================
+ *  Copyright 2001-2014 Monkey Software LLC <eduardo@monkey.io>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mk_http_desc.h"
+
+#define span_set(s, ptr)                                        \
+    s.off = (ptr).data ? (uint32_t) ((ptr).data - buffer) : 0;  \
+    s.len = (uint32_t) (ptr).len
+
+/* Number of bytes required to describe a parsed request */
+int mk_http_desc_size(struct mk_http_parser *req)
+{
+    int i;
+    int n = 0;
+
+    for (i = 0; i < MK_HEADER_SIZEOF; i++) {
+        if (req->headers[i].type == i) {
+            n++;
+        }
+    }
+
+    return sizeof(struct mk_http_desc) + n * sizeof(struct mk_http_desc_span);
+}
+
+/*
+ * Write the descriptor of a complete request parsed from 'buffer' into
+ * 'out'. Returns the number of bytes written or -1 if the request is not
+ * complete or 'size' is not enough.
+ */
+int mk_http_desc_write(struct mk_http_parser *req, char *buffer,
+                       void *out, int size)
+{
+    int i;
+    int n = 0;
+    long body_len;
+    struct mk_http_desc *desc = out;
+
+    if (req->body_start < 0 || mk_http_desc_size(req) > size) {
+        return -1;
+    }
+
+    body_len = (req->header_content_length > 0) ?
+        req->header_content_length : 0;
+    if (req->body_received < body_len) {
+        return -1;
+    }
+    if (req->body_start + body_len > UINT32_MAX) {
+        return -1;
+    }
+
+    desc->headers_mask = 0;
+    for (i = 0; i < MK_HEADER_SIZEOF; i++) {
+        if (req->headers[i].type != i) {
+            continue;
+        }
+        desc->headers_mask |= (1u << i);
+        span_set(desc->header[n], req->headers[i].val);
+        n++;
+    }
+
+    desc->version     = MK_HTTP_DESC_VERSION;
+    desc->headers     = n;
+    desc->size        = sizeof(struct mk_http_desc) +
+        n * sizeof(struct mk_http_desc_span);
+    desc->fingerprint = req->fingerprint;
+    desc->length      = req->body_start + body_len;
+    desc->reserved    = 0;
+
+    span_set(desc->method, req->method);
+    span_set(desc->uri, req->uri);
+    span_set(desc->query_string, req->query_string);
+    span_set(desc->protocol, req->protocol);
+    desc->body.off = req->body_start;
+    desc->body.len = body_len;
+
+    return desc->size;
+}
+
+/*
+ * Validate a descriptor received from another context: version, size and
+ * every span must be inside the raw request. Returns 0 if it's valid.
+ */
+int mk_http_desc_check(void *data, int size, unsigned long raw_len)
+{
+    int i;
+    struct mk_http_desc *desc = data;
+    struct mk_http_desc_span *s;
+    struct mk_http_desc_span *line[] = {
+        &desc->method, &desc->uri, &desc->query_string,
+        &desc->protocol, &desc->body
+    };
+
+    if (size < sizeof(struct mk_http_desc) ||
+        desc->version != MK_HTTP_DESC_VERSION ||
+        desc->size != sizeof(struct mk_http_desc) +
+        desc->headers * sizeof(struct mk_http_desc_span) ||
+        desc->size > size ||
+        __builtin_popcount(desc->headers_mask) != desc->headers ||
+        desc->length > raw_len) {
+        return -1;
+    }
+
+    for (i = 0; i < 5 + desc->headers; i++) {
+        s = (i < 5) ? line[i] : &desc->header[i - 5];
+        if ((uint64_t) s->off + s->len > desc->length) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/* Get a known header value, returns 0 if the request have it, otherwise -1 */
+int mk_http_desc_header(struct mk_http_desc *desc, char *raw, int header,
+                        mk_ptr_t *val)
+{
+    int n;
+    uint32_t bit;
+
+    if (header < 0 || header >= MK_HEADER_SIZEOF) {
+        return -1;
+    }
+
+    bit = (1u << header);
+    if (!(desc->headers_mask & bit)) {
+        return -1;
+    }
+
+    /* the span position is the number of present headers before it */
+    n = __builtin_popcount(desc->headers_mask & (bit - 1));
+    *val = mk_http_desc_ptr(raw, &desc->header[n]);
+    return 0;
+}
@@ -0,0 +1,84 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Monkey HTTP Server
+ *  ==================
+ *  Copyright 2001-2014 Monkey Software LLC <eduardo@monkey.io>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <stdint.h>
+
+#include "mk_http_parser.h"
+
+#ifndef MK_HTTP_DESC_H
+#define MK_HTTP_DESC_H
+
+/*
+ * Parsed request descriptor
+ * =========================
+ *
+ * Position independent representation of a parsed request: every field is
+ * an offset/length pair relative to the raw request bytes, so it can be
+ * copied next to them (e.g. a shared memory ring) and used by another
+ * thread or process without parsing again. Integers are stored in the
+ * host byte order.
+ *
+ * The version must be increased when the layout or the MK_HEADER_* list
+ * changes, as known headers are stored by id.
+ */
+#define MK_HTTP_DESC_VERSION  3
+
+struct mk_http_desc_span {
+    uint32_t off;
+    uint32_t len;
+};
+
+/* 64 bytes header followed by one span per header set in 'headers_mask' */
+struct mk_http_desc {
+    uint8_t  version;
+    uint8_t  headers;             /* number of header spans             */
+    uint16_t size;                /* descriptor size                    */
+    uint32_t headers_mask;        /* bit per known header (MK_HEADER_*) */
+    uint64_t fingerprint;
+    uint32_t length;              /* raw request length, body included  */
+    uint32_t reserved;
+
+    struct mk_http_desc_span method;
+    struct mk_http_desc_span uri;
+    struct mk_http_desc_span query_string;
+    struct mk_http_desc_span protocol;
+    struct mk_http_desc_span body;
+
+    struct mk_http_desc_span header[];   /* values, ordered by id */
+};
+
+int mk_http_desc_size(struct mk_http_parser *req);
+int mk_http_desc_write(struct mk_http_parser *req, char *buffer,
+                       void *out, int size);
+int mk_http_desc_check(void *data, int size, unsigned long raw_len);
+int mk_http_desc_header(struct mk_http_desc *desc, char *raw, int header,
+                        mk_ptr_t *val);
+
+/* Convert a descriptor span to a pointer span on the reader raw bytes */
+static inline mk_ptr_t mk_http_desc_ptr(char *raw,
+                                        struct mk_http_desc_span *span)
+{
+    mk_ptr_t p;
+
+    p.data = raw + span->off;
+    p.len  = span->len;
+    return p;
+}
+
+#endif /* MK_HTTP_DESC_H */
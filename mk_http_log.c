@@ -0,0 +1,376 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Monkey HTTP Server
+ *  ==================
+ *  Copyright 2001-2014 Monkey Software LLC <eduardo@monkey.io>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/uio.h>
+
+#include "mk_http_log.h"
+
+/* Fixed bytes of a record (names, separators and numbers) */
+#define LOG_RECORD_FIXED  192
+
+/* Word at a time tests, true if any byte of 'x' matches */
+#define ONES              0x0101010101010101ULL
+#define HIGHS             0x8080808080808080ULL
+#define has_zero(x)       (((x) - ONES) & ~(x) & HIGHS)
+#define has_byte(x, b)    has_zero((x) ^ (ONES * (b)))
+#define has_less(x, n)    (((x) - ONES * (n)) & ~(x) & HIGHS)
+
+static const char hex[] = "0123456789abcdef";
+
+/* Copy 'len' bytes at the ring head, wrapping at the end */
+static inline void ring_put(struct mk_http_log *log, const char *src,
+                            unsigned long len)
+{
+    unsigned long n;
+
+    n = log->size - log->head;
+    if (len < n) {
+        memcpy(log->buf + log->head, src, len);
+        log->head += len;
+    }
+    else {
+        memcpy(log->buf + log->head, src, n);
+        memcpy(log->buf, src + n, len - n);
+        log->head = len - n;
+    }
+    log->used += len;
+}
+
+#define ring_str(log, s)  ring_put(log, s, sizeof(s) - 1)
+
+static inline void ring_num(struct mk_http_log *log, long v)
+{
+    char tmp[24];
+    char *p = tmp + sizeof(tmp);
+    int neg = v < 0;
+
+    if (neg) {
+        v = -v;
+    }
+    do {
+        *--p = '0' + (v % 10);
+        v /= 10;
+    } while (v > 0);
+    if (neg) {
+        *--p = '-';
+    }
+    ring_put(log, p, (tmp + sizeof(tmp)) - p);
+}
+
+static inline int log_special(int format, unsigned char c)
+{
+    if (c < 0x20 || c == '"' || c == '\\') {
+        return 1;
+    }
+    /* TEXT lines are kept ASCII, JSON passes UTF-8 sequences */
+    if (format == MK_LOG_TEXT && c >= 0x7f) {
+        return 1;
+    }
+    return 0;
+}
+
+static inline int log_special_word(int format, uint64_t w)
+{
+    uint64_t r;
+
+    r = has_less(w, 0x20) | has_byte(w, '"') | has_byte(w, '\\');
+    if (format == MK_LOG_TEXT) {
+        r |= (w & HIGHS) | has_byte(w, 0x7f);
+    }
+    return r != 0;
+}
+
+static inline void log_escape_byte(struct mk_http_log *log, unsigned char c)
+{
+    char tmp[6];
+
+    if (c == '"' || c == '\\') {
+        tmp[0] = '\\';
+        tmp[1] = c;
+        ring_put(log, tmp, 2);
+    }
+    else if (log->format == MK_LOG_JSON) {
+        memcpy(tmp, "\\u00", 4);
+        tmp[4] = hex[c >> 4];
+        tmp[5] = hex[c & 0xf];
+        ring_put(log, tmp, 6);
+    }
+    else {
+        tmp[0] = '\\';
+        tmp[1] = 'x';
+        tmp[2] = hex[c >> 4];
+        tmp[3] = hex[c & 0xf];
+        ring_put(log, tmp, 4);
+    }
+}
+
+/*
+ * Escape a span into the ring. Bytes are checked eight at a time and
+ * runs without special characters are copied at once.
+ */
+static void log_escape(struct mk_http_log *log, const char *data,
+                       unsigned long len)
+{
+    unsigned long i = 0;
+    unsigned long run = 0;
+    unsigned long end;
+    uint64_t w;
+
+    while (i < len) {
+        if (i + 8 <= len) {
+            memcpy(&w, data + i, 8);
+            if (!log_special_word(log->format, w)) {
+                i += 8;
+                continue;
+            }
+            end = i + 8;
+        }
+        else {
+            end = len;
+        }
+
+        for (; i < end; i++) {
+            if (log_special(log->format, (unsigned char) data[i])) {
+                ring_put(log, data + run, i - run);
+                log_escape_byte(log, (unsigned char) data[i]);
+                run = i + 1;
+            }
+        }
+    }
+    ring_put(log, data + run, len - run);
+}
+
+/* Unquoted span, or the missing value mark */
+static inline void log_span(struct mk_http_log *log, mk_ptr_t *f)
+{
+    if (!f->data) {
+        ring_str(log, "-");
+        return;
+    }
+    log_escape(log, f->data, f->len);
+}
+
+/* Quoted span, or the missing value mark */
+static inline void log_field(struct mk_http_log *log, mk_ptr_t *f)
+{
+    if (!f->data) {
+        if (log->format == MK_LOG_JSON) {
+            ring_str(log, "null");
+        }
+        else {
+            ring_str(log, "-");
+        }
+        return;
+    }
+
+    ring_str(log, "\"");
+    log_escape(log, f->data, f->len);
+    ring_str(log, "\"");
+}
+
+static inline mk_ptr_t *log_header(struct mk_http_parser *req, int header,
+                                   mk_ptr_t *none)
+{
+    if (req->headers[header].type == header) {
+        return &req->headers[header].val;
+    }
+    return none;
+}
+
+struct mk_http_log *mk_http_log_create(int fd, int format,
+                                       unsigned long size)
+{
+    struct mk_http_log *log;
+
+    if (format != MK_LOG_TEXT && format != MK_LOG_JSON) {
+        return NULL;
+    }
+
+    log = malloc(sizeof(struct mk_http_log));
+    if (!log) {
+        return NULL;
+    }
+
+    log->buf = malloc(size);
+    if (!log->buf) {
+        free(log);
+        return NULL;
+    }
+
+    log->fd      = fd;
+    log->format  = format;
+    log->size    = size;
+    log->head    = 0;
+    log->used    = 0;
+    log->flush   = size / 2;
+    log->dropped = 0;
+    return log;
+}
+
+/*
+ * Write the pending records, returns the number of bytes written or -1
+ * on error. If the descriptor is non-blocking the remaining bytes are
+ * kept for the next flush.
+ */
+long mk_http_log_flush(struct mk_http_log *log)
+{
+    int n;
+    long total = 0;
+    ssize_t bytes;
+    unsigned long tail;
+    struct iovec iov[2];
+
+    while (log->used > 0) {
+        tail = (log->head + log->size - log->used) % log->size;
+        if (tail < log->head) {
+            iov[0].iov_base = log->buf + tail;
+            iov[0].iov_len  = log->used;
+            n = 1;
+        }
+        else {
+            iov[0].iov_base = log->buf + tail;
+            iov[0].iov_len  = log->size - tail;
+            iov[1].iov_base = log->buf;
+            iov[1].iov_len  = log->head;
+            n = (log->head > 0) ? 2 : 1;
+        }
+
+        bytes = writev(log->fd, iov, n);
+        if (bytes == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN) {
+                break;
+            }
+            return -1;
+        }
+        log->used -= bytes;
+        total     += bytes;
+    }
+
+    return total;
+}
+
+/*
+ * Append the record of a served request, 'bytes' is the response size.
+ * Returns -1 if the record was dropped because the ring is full.
+ */
+int mk_http_log_request(struct mk_http_log *log, struct mk_http_parser *req,
+                        time_t now, int status, long bytes)
+{
+    int json = (log->format == MK_LOG_JSON);
+    unsigned long max;
+    mk_ptr_t none = {NULL, 0};
+    mk_ptr_t *host;
+    mk_ptr_t *referer;
+    mk_ptr_t *user_agent;
+
+    host       = log_header(req, MK_HEADER_HOST, &none);
+    referer    = log_header(req, MK_HEADER_REFERER, &none);
+    user_agent = log_header(req, MK_HEADER_USER_AGENT, &none);
+
+    /* Worst case size, every byte escaped */
+    max = req->method.len + req->uri.len + req->query_string.len +
+        req->protocol.len + host->len + referer->len + user_agent->len;
+    max = max * (json ? 6 : 4) + LOG_RECORD_FIXED;
+
+    if (log->size - log->used < max) {
+        mk_http_log_flush(log);
+        if (log->size - log->used < max) {
+            log->dropped++;
+            return -1;
+        }
+    }
+
+    if (json) {
+        ring_str(log, "{\"time\":");
+        ring_num(log, now);
+        ring_str(log, ",\"host\":");
+        log_field(log, host);
+        ring_str(log, ",\"method\":");
+        log_field(log, &req->method);
+        ring_str(log, ",\"uri\":");
+        log_field(log, &req->uri);
+        ring_str(log, ",\"query\":");
+        log_field(log, &req->query_string);
+        ring_str(log, ",\"protocol\":");
+        log_field(log, &req->protocol);
+        ring_str(log, ",\"status\":");
+        ring_num(log, status);
+        ring_str(log, ",\"bytes\":");
+        ring_num(log, bytes);
+        ring_str(log, ",\"referer\":");
+        log_field(log, referer);
+        ring_str(log, ",\"user_agent\":");
+        log_field(log, user_agent);
+        ring_str(log, "}\n");
+    }
+    else {
+        ring_num(log, now);
+        ring_str(log, " ");
+        log_field(log, host);
+        ring_str(log, " ");
+        if (req->method.data) {
+            ring_str(log, "\"");
+            log_escape(log, req->method.data, req->method.len);
+            ring_str(log, " ");
+            log_span(log, &req->uri);
+            if (req->query_string.data) {
+                ring_str(log, "?");
+                log_escape(log, req->query_string.data,
+                           req->query_string.len);
+            }
+            ring_str(log, " ");
+            log_span(log, &req->protocol);
+            ring_str(log, "\"");
+        }
+        else {
+            ring_str(log, "-");
+        }
+        ring_str(log, " ");
+        ring_num(log, status);
+        ring_str(log, " ");
+        ring_num(log, bytes);
+        ring_str(log, " ");
+        log_field(log, referer);
+        ring_str(log, " ");
+        log_field(log, user_agent);
+        ring_str(log, "\n");
+    }
+
+    if (log->used >= log->flush) {
+        mk_http_log_flush(log);
+    }
+    return 0;
+}
+
+/* Flush the pending records and release the context */
+void mk_http_log_destroy(struct mk_http_log *log)
+{
+    mk_http_log_flush(log);
+    free(log->buf);
+    free(log);
+}
@@ -0,0 +1,69 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Monkey HTTP Server
+ *  ==================
+ *  Copyright 2001-2014 Monkey Software LLC <eduardo@monkey.io>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <time.h>
+
+#include "mk_http_parser.h"
+
+#ifndef MK_HTTP_LOG_H
+#define MK_HTTP_LOG_H
+
+/* Records format */
+#define MK_LOG_TEXT   0
+#define MK_LOG_JSON   1
+
+/*
+ * Access log
+ * ==========
+ *
+ * Records are built straight from the parser spans (request line, Host,
+ * User-Agent and Referer slots) and escaped into a ring buffer, which is
+ * written to 'fd' in batches once 'flush' bytes are pending. A context
+ * is not locked: every thread owns its own context, all of them can
+ * share the same file descriptor opened with O_APPEND.
+ *
+ * TEXT: 1416231513 "host" "GET /uri?query HTTP/1.1" 200 1024 "referer" "ua"
+ * JSON: {"time":1416231513,"host":"host","method":"GET","uri":"/uri",
+ *        "query":"query","protocol":"HTTP/1.1","status":200,"bytes":1024,
+ *        "referer":"referer","user_agent":"ua"}
+ *
+ * Missing fields are written as "-" on TEXT and null on JSON, a request
+ * line which was not parsed is written as a single "-" on TEXT. Room for
+ * the worst case escaping of a record is reserved before writing it, a
+ * record which can not fit on an empty ring is dropped and counted.
+ */
+struct mk_http_log {
+    int fd;
+    int format;
+    unsigned long size;     /* ring size                         */
+    unsigned long head;     /* write offset                      */
+    unsigned long used;     /* pending bytes                     */
+    unsigned long flush;    /* pending bytes to trigger a write  */
+    unsigned long dropped;  /* records that did not fit          */
+    char *buf;
+};
+
+struct mk_http_log *mk_http_log_create(int fd, int format,
+                                       unsigned long size);
+int mk_http_log_request(struct mk_http_log *log, struct mk_http_parser *req,
+                        time_t now, int status, long bytes);
+long mk_http_log_flush(struct mk_http_log *log);
+void mk_http_log_destroy(struct mk_http_log *log);
+
+#endif /* MK_HTTP_LOG_H */
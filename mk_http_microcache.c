@@ -0,0 +1,147 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Monkey HTTP Server
+ *  ==================
+ *  Copyright 2001-2014 Monkey Software LLC <eduardo@monkey.io>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mk_http_microcache.h"
+
+#define CACHE_LINE  64
+
+static inline struct mk_http_microcache_slot *
+slot_get(struct mk_http_microcache *cache, uint64_t key)
+{
+    /* the low bits of the fingerprint are as good as the high ones */
+    return (struct mk_http_microcache_slot *)
+        (cache->table + (key & (cache->slots - 1)) * cache->stride);
+}
+
+/*
+ * Create a cache, 'slots' is rounded up to a power of 2 and 'slot_size' is
+ * the maximum size of a cached response.
+ */
+struct mk_http_microcache *mk_http_microcache_create(int slots,
+                                                     int slot_size)
+{
+    int n = 1;
+    struct mk_http_microcache *cache;
+
+    if (slots < 1 || slot_size < 1) {
+        return NULL;
+    }
+
+    while (n < slots) {
+        n <<= 1;
+    }
+
+    cache = malloc(sizeof(struct mk_http_microcache));
+    if (!cache) {
+        return NULL;
+    }
+
+    cache->slots     = n;
+    cache->slot_size = slot_size;
+    cache->stride    = sizeof(struct mk_http_microcache_slot) + slot_size;
+    cache->stride    = (cache->stride + CACHE_LINE - 1) & ~(CACHE_LINE - 1);
+
+    /* key zero and expire zero: every slot starts expired */
+    if (posix_memalign((void **) &cache->table, CACHE_LINE,
+                       (size_t) n * cache->stride) != 0) {
+        free(cache);
+        return NULL;
+    }
+    memset(cache->table, '\0', (size_t) n * cache->stride);
+
+    return cache;
+}
+
+void mk_http_microcache_destroy(struct mk_http_microcache *cache)
+{
+    free(cache->table);
+    free(cache);
+}
+
+/*
+ * Copy the response cached for 'key' into 'buf'. Returns the response
+ * length or -1 on a miss (not found, expired, too big or being updated).
+ */
+int mk_http_microcache_get(struct mk_http_microcache *cache, uint64_t key,
+                           time_t now, char *buf, int size)
+{
+    int len;
+    uint32_t seq;
+    struct mk_http_microcache_slot *slot;
+
+    slot = slot_get(cache, key);
+
+    seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+    if (seq & 1) {
+        return -1;
+    }
+
+    len = slot->len;
+    if (slot->key != key || slot->expire <= now || len > size) {
+        return -1;
+    }
+    memcpy(buf, slot->data, len);
+
+    /* the copy is valid only if no writer touched the slot meanwhile */
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) != seq) {
+        return -1;
+    }
+
+    return len;
+}
+
+/*
+ * Store a response for 'key' valid until 'expire'. Returns 0 on success or
+ * -1 if the response does not fit or the slot is owned by another writer.
+ */
+int mk_http_microcache_put(struct mk_http_microcache *cache, uint64_t key,
+                           time_t expire, char *data, int len)
+{
+    uint32_t seq;
+    struct mk_http_microcache_slot *slot;
+
+    if (len > cache->slot_size) {
+        return -1;
+    }
+
+    slot = slot_get(cache, key);
+    seq  = __atomic_load_n(&slot->seq, __ATOMIC_RELAXED);
+    if (seq & 1) {
+        return -1;
+    }
+
+    if (!__atomic_compare_exchange_n(&slot->seq, &seq, seq + 1, 0,
+                                     __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        return -1;
+    }
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    slot->key    = key;
+    slot->expire = expire;
+    slot->len    = len;
+    memcpy(slot->data, data, len);
+
+    __atomic_store_n(&slot->seq, seq + 2, __ATOMIC_RELEASE);
+    return 0;
+}
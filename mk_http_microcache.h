@@ -0,0 +1,59 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Monkey HTTP Server
+ *  ==================
+ *  Copyright 2001-2014 Monkey Software LLC <eduardo@monkey.io>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <stdint.h>
+#include <time.h>
+
+#ifndef MK_HTTP_MICROCACHE_H
+#define MK_HTTP_MICROCACHE_H
+
+/*
+ * Responses micro-cache
+ * =====================
+ *
+ * A fixed size table of responses keyed by the request fingerprint, it's
+ * shared by all threads without locks: every slot is protected by a
+ * sequence counter (odd while a writer owns it). Readers copy the
+ * response and validate the counter, a concurrent update is just a miss.
+ * Writers that find a busy slot skip the store.
+ */
+struct mk_http_microcache_slot {
+    uint32_t seq;
+    int len;
+    uint64_t key;
+    time_t expire;
+    char data[];
+};
+
+struct mk_http_microcache {
+    int slots;         /* power of 2          */
+    int slot_size;     /* max response size   */
+    int stride;        /* slot size in memory */
+    char *table;
+};
+
+struct mk_http_microcache *mk_http_microcache_create(int slots,
+                                                     int slot_size);
+void mk_http_microcache_destroy(struct mk_http_microcache *cache);
+int mk_http_microcache_get(struct mk_http_microcache *cache, uint64_t key,
+                           time_t now, char *buf, int size);
+int mk_http_microcache_put(struct mk_http_microcache *cache, uint64_t key,
+                           time_t expire, char *data, int len);
+
+#endif /* MK_HTTP_MICROCACHE_H */
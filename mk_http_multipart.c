@@ -0,0 +1,278 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Monkey HTTP Server
+ *  ==================
+ *  Copyright 2001-2014 Monkey Software LLC <eduardo@monkey.io>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "mk_http_multipart.h"
+
+/*
+ * Lookup the delimiter inside buffer[pos..len], it returns the offset where
+ * the delimiter starts or -1 if it was not found. In the last case 'hold'
+ * is set to the number of trailing bytes that are a delimiter prefix, they
+ * cannot be released until more data arrives.
+ *
+ * The search is a Boyer-Moore-Horspool, the delimiter is usually long (40+
+ * bytes) so most of the body bytes are never touched.
+ */
+static int delim_search(struct mk_http_multipart *mp,
+                        char *buffer, int pos, int len, int *hold)
+{
+    int i;
+    int n;
+    unsigned char c = 0;
+    unsigned char last;
+    char *p;
+    char *end;
+
+    n    = mp->delim_len;
+    last = mp->delim[n - 1];
+
+    for (i = pos; i + n <= len; i += mp->shift[c]) {
+        c = buffer[i + n - 1];
+        if (c == last && memcmp(buffer + i, mp->delim, n - 1) == 0) {
+            return i;
+        }
+    }
+
+    /* Partial delimiter at the end, it always starts with a CR */
+    *hold = 0;
+    p   = buffer + ((len - (n - 1) > pos) ? len - (n - 1) : pos);
+    end = buffer + len;
+    while ((p = memchr(p, '\r', end - p)) != NULL) {
+        if (memcmp(p, mp->delim, end - p) == 0) {
+            *hold = end - p;
+            break;
+        }
+        p++;
+    }
+
+    return -1;
+}
+
+/*
+ * Locate the end of a part headers block: an empty line or a set of
+ * header rows ended with an empty line. Returns the offset after the
+ * block or -1 if it's not complete.
+ */
+static int headers_end(char *buffer, int pos, int len)
+{
+    char *p;
+    char *end;
+
+    end = buffer + len;
+    if (len - pos >= 2 && buffer[pos] == '\r' && buffer[pos + 1] == '\n') {
+        return pos + 2;
+    }
+
+    p = buffer + pos;
+    while ((p = memchr(p, '\n', end - p)) != NULL) {
+        /* a LF at the block start can't end a header row */
+        if (p > buffer + pos && end - p >= 3 &&
+            p[-1] == '\r' && p[1] == '\r' && p[2] == '\n') {
+            return (p + 3) - buffer;
+        }
+        p++;
+    }
+
+    return -1;
+}
+
+/*
+ * Prepare a multipart context based on the boundary parameter set in the
+ * request Content-Type header.
+ */
+int mk_http_multipart_init(struct mk_http_multipart *mp,
+                           struct mk_http_parser *req)
+{
+    int i;
+    int n;
+    mk_ptr_t boundary;
+    struct mk_http_header *header;
+
+    header = &req->headers[MK_HEADER_CONTENT_TYPE];
+    if (header->type != MK_HEADER_CONTENT_TYPE) {
+        return -1;
+    }
+
+    if (header->val.len < 10 ||
+        strncasecmp(header->val.data, "multipart/", 10) != 0) {
+        return -1;
+    }
+
+    if (mk_http_header_param(&header->val, "boundary", &boundary) != 0) {
+        return -1;
+    }
+
+    if (boundary.len < 1 || boundary.len > MK_MP_BOUNDARY_MAX) {
+        return -1;
+    }
+
+    mp->level    = MK_MP_LEVEL_PREAMBLE;
+    mp->first    = 1;
+    mp->consumed = 0;
+    mp->data.data = NULL;
+    mp->data.len  = 0;
+
+    /* delimiter */
+    memcpy(mp->delim, "\r\n--", 4);
+    memcpy(mp->delim + 4, boundary.data, boundary.len);
+    mp->delim_len = n = boundary.len + 4;
+
+    /* Horspool shift table */
+    for (i = 0; i < 256; i++) {
+        mp->shift[i] = n;
+    }
+    for (i = 0; i < n - 1; i++) {
+        mp->shift[(unsigned char) mp->delim[i]] = n - 1 - i;
+    }
+
+    return 0;
+}
+
+/*
+ * Parse a chunk of a multipart body, it returns one event or MK_HTTP_PENDING
+ * and MK_HTTP_ERROR like the main parser. The buffer is not copied, spans
+ * reported by the events points to it. After every call the caller must
+ * discard mp->consumed bytes from the buffer and provide the rest (plus new
+ * data) in the next call.
+ */
+int mk_http_multipart_parse(struct mk_http_multipart *mp,
+                            char *buffer, int len)
+{
+    int j;
+    int n;
+    int ret;
+    int end;
+    int pos = 0;
+    int hold = 0;
+
+    mp->consumed = 0;
+
+    while (1) {
+        switch (mp->level) {
+        case MK_MP_LEVEL_PREAMBLE:
+            /* The first boundary may come without the leading CRLF */
+            if (mp->first) {
+                n = mp->delim_len - 2;
+                if (len < n) {
+                    if (memcmp(buffer, mp->delim + 2, len) == 0) {
+                        return MK_HTTP_PENDING;
+                    }
+                }
+                else if (memcmp(buffer, mp->delim + 2, n) == 0) {
+                    pos = n;
+                    mp->first = 0;
+                    mp->level = MK_MP_LEVEL_BOUNDARY;
+                    continue;
+                }
+                mp->first = 0;
+            }
+
+            /* Preamble data is discarded */
+            ret = delim_search(mp, buffer, pos, len, &hold);
+            if (ret == -1) {
+                mp->consumed = len - hold;
+                return MK_HTTP_PENDING;
+            }
+            pos = ret + mp->delim_len;
+            mp->level = MK_MP_LEVEL_BOUNDARY;
+            break;
+        case MK_MP_LEVEL_BOUNDARY:
+            if (len - pos < 2) {
+                mp->consumed = pos;
+                return MK_HTTP_PENDING;
+            }
+
+            /* Close delimiter, the epilogue is ignored */
+            if (buffer[pos] == '-' && buffer[pos + 1] == '-') {
+                mp->level = MK_MP_LEVEL_DONE;
+                mp->consumed = len;
+                return MK_MP_DONE;
+            }
+
+            /* Optional transport padding */
+            for (j = pos; j < len && (buffer[j] == ' ' || buffer[j] == '\t');
+                 j++);
+
+            if (len - j < 2) {
+                mp->consumed = pos;
+                return MK_HTTP_PENDING;
+            }
+            if (buffer[j] != '\r' || buffer[j + 1] != '\n') {
+                return MK_HTTP_ERROR;
+            }
+            pos = j + 2;
+            mp->level = MK_MP_LEVEL_HEADERS;
+            break;
+        case MK_MP_LEVEL_HEADERS:
+            end = headers_end(buffer, pos, len);
+            if (end == -1) {
+                if (len - pos > MK_MP_HEADERS_MAX) {
+                    return MK_HTTP_ERROR;
+                }
+                mp->consumed = pos;
+                return MK_HTTP_PENDING;
+            }
+
+            /* Part headers are parsed by the common headers states */
+            mk_http_parser_init(&mp->part);
+            mp->part.level = REQ_LEVEL_CONTINUE;
+            ret = mk_http_parser(&mp->part, buffer + pos, end - pos);
+            if (ret == MK_HTTP_ERROR) {
+                return MK_HTTP_ERROR;
+            }
+
+            mp->level = MK_MP_LEVEL_DATA;
+            mp->consumed = end;
+            return MK_MP_PART_HEADERS;
+        case MK_MP_LEVEL_DATA:
+            ret = delim_search(mp, buffer, pos, len, &hold);
+            if (ret == pos) {
+                mp->level = MK_MP_LEVEL_BOUNDARY;
+                mp->consumed = pos + mp->delim_len;
+                return MK_MP_PART_END;
+            }
+
+            if (ret == -1) {
+                end = len - hold;
+            }
+            else {
+                end = ret;
+            }
+
+            if (end == pos) {
+                mp->consumed = pos;
+                return MK_HTTP_PENDING;
+            }
+
+            mp->data.data = buffer + pos;
+            mp->data.len  = end - pos;
+            mp->consumed  = end;
+            return MK_MP_PART_DATA;
+        case MK_MP_LEVEL_DONE:
+            mp->consumed = len;
+            return MK_MP_DONE;
+        default:
+            return MK_HTTP_ERROR;
+        };
+    }
+}
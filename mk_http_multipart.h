@@ -0,0 +1,81 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Monkey HTTP Server
+ *  ==================
+ *  Copyright 2001-2014 Monkey Software LLC <eduardo@monkey.io>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include "mk_http_parser.h"
+
+#ifndef MK_HTTP_MULTIPART_H
+#define MK_HTTP_MULTIPART_H
+
+#define MK_MP_BOUNDARY_MAX    70     /* RFC 2046 */
+#define MK_MP_HEADERS_MAX   8192     /* max size of a part headers block */
+
+/*
+ * Multipart events
+ * ================
+ *
+ * Returned by mk_http_multipart_parse(), on each call just one event is
+ * reported. For a body the sequence looks like:
+ *
+ *   PART_HEADERS, PART_DATA (0..N), PART_END, ..., DONE
+ */
+enum {
+    MK_MP_PART_HEADERS = 1,   /* mp->part contains the part headers      */
+    MK_MP_PART_DATA       ,   /* mp->data points to a chunk of part data */
+    MK_MP_PART_END        ,   /* the current part have finished          */
+    MK_MP_DONE                /* closing boundary found                  */
+};
+
+/* Multipart levels */
+enum {
+    MK_MP_LEVEL_PREAMBLE = 1,
+    MK_MP_LEVEL_BOUNDARY    ,     /* after a delimiter: '--' or CRLF */
+    MK_MP_LEVEL_HEADERS     ,
+    MK_MP_LEVEL_DATA        ,
+    MK_MP_LEVEL_DONE
+};
+
+/* Multipart 'Parser Context' */
+struct mk_http_multipart {
+    int level;
+    int first;       /* the body may start with the boundary, no CRLF */
+
+    /*
+     * Number of bytes processed from the last given buffer, the caller
+     * must keep the remaining bytes and prepend them to the next call.
+     */
+    int consumed;
+
+    /* MK_MP_PART_DATA: data span inside the caller buffer */
+    mk_ptr_t data;
+
+    /* MK_MP_PART_HEADERS: headers of the current part */
+    struct mk_http_parser part;
+
+    /* delimiter: CRLF + '--' + boundary and its Horspool shift table */
+    int delim_len;
+    char delim[MK_MP_BOUNDARY_MAX + 4];
+    unsigned char shift[256];
+};
+
+int mk_http_multipart_init(struct mk_http_multipart *mp,
+                           struct mk_http_parser *req);
+int mk_http_multipart_parse(struct mk_http_multipart *mp,
+                            char *buffer, int len);
+
+#endif /* MK_HTTP_MULTIPART_H */
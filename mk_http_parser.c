@@ -20,49 +20,83 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <errno.h>
 #include <stdint.h>
 #include <limits.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
 
 #include "mk_http_parser.h"
 
+#ifdef HTTP_STANDALONE
 #define mark_end()                              \
     req->end = req->i;                          \
     req->chars = -1;                            \
     eval_field(req, buffer)
+#else
+#define mark_end()                              \
+    req->end = req->i;                          \
+    req->chars = -1
+#endif
 
 #define parse_next()                            \
     req->start = req->i + 1;                    \
     continue
 
 #define field_len()   (req->end - req->start)
-#define header_scope_eq(req, x) req->header_min = req->header_max = x
 
-struct header_entry {
-    int len;
-    const char name[32];
-};
+/* A complete request, it may ask for an upgrade to h2c */
+#define request_complete()                                  \
+    (req->h2c ? MK_HTTP_H2C_UPGRADE : MK_HTTP_OK)
 
+/* Register the marked field on a request line span */
+#define mark_field(f)                           \
+    f.data = buffer + req->start;               \
+    f.len  = field_len()
+
+/* Fold the marked field plus its delimiter into the request fingerprint */
+#define fp_field()                                                      \
+    req->fp_line = mk_http_hash64(req->fp_line, buffer + req->start,    \
+                                  field_len() + 1)
+
+#define fp_final()                                      \
+    req->fingerprint = req->fp_line ^ req->fp_headers
+#define header_scope_eq(req, x) req->header_min = req->header_max = x
+
+/*
+ * Known headers names, they are followed by ': ' so the response builder
+ * can emit them straight from this table.
+ */
 struct header_entry headers_table[] = {
-    {  6, "Accept"              },
-    { 14, "Accept-Charset"      },
-    { 15, "Accept-Encoding"     },
-    { 15, "Accept-Language"     },
-    { 13, "Authorization"       },
-    {  6, "Cookie"              },
-    { 10, "Connection"          },
-    { 14, "Content-Length"      },
-    { 13, "Content-Range"       },
-    { 12, "Content-Type"        },
-    { 17, "If-Modified-Since"   },
-    {  4, "Host"                },
-    { 13, "Last-Modified"       },
-    { 19, "Last-Modified-Since" },
-    {  7, "Referer"             },
-    {  5, "Range"               },
-    { 10, "User-Agent"          }
+    {  6, "Accept: "              },
+    { 14, "Accept-Charset: "      },
+    { 15, "Accept-Encoding: "     },
+    { 15, "Accept-Language: "     },
+    { 13, "Authorization: "       },
+    {  6, "Cookie: "              },
+    { 10, "Connection: "          },
+    { 19, "Content-Disposition: " },
+    { 14, "Content-Length: "      },
+    { 13, "Content-Range: "       },
+    { 12, "Content-Type: "        },
+    {  6, "Expect: "              },
+    { 17, "If-Modified-Since: "   },
+    {  4, "Host: "                },
+    { 14, "HTTP2-Settings: "      },
+    { 13, "Last-Modified: "       },
+    { 19, "Last-Modified-Since: " },
+    {  7, "Referer: "             },
+    {  5, "Range: "               },
+    {  7, "Upgrade: "             },
+    { 10, "User-Agent: "          },
+    { 12, "X-Request-Id: "        }
 };
 
+/* HTTP/2 connection preface (RFC 7540 3.5) */
+static const char h2_preface[] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+#define H2_PREFACE_LEN  (sizeof(h2_preface) - 1)
+
 /* Macro just for testing the parser on specific locations */
 #define remaining()                                                     \
     {                                                                   \
@@ -116,6 +150,7 @@ static inline int header_lookup(struct mk_http_parser *req, char *buffer)
                 long val;
                 char *endptr;
 
+                errno = 0;
                 val = strtol(header->val.data, &endptr, 10);
                 if ((errno == ERANGE && (val == LONG_MAX || val == LONG_MIN))
                     || (errno != 0 && val == 0)) {
@@ -131,8 +166,15 @@ static inline int header_lookup(struct mk_http_parser *req, char *buffer)
                 req->header_content_length = val;
             }
 
-            printf("                 ===> %sMATCH%s '%s' = '",
-                   ANSI_YELLOW, ANSI_RESET, h->name);
+            if (req->fp_mask & MK_HTTP_FP_BIT(i)) {
+                req->fp_headers += mk_http_hash64(MK_HTTP_HASH64_INIT ^ i,
+                                                  header->val.data,
+                                                  header->val.len);
+            }
+
+#ifdef HTTP_STANDALONE
+            printf("                 ===> %sMATCH%s '%.*s' = '",
+                   ANSI_YELLOW, ANSI_RESET, h->len, h->name);
 
 
             int z;
@@ -140,14 +182,56 @@ static inline int header_lookup(struct mk_http_parser *req, char *buffer)
                 printf("%c", buffer[z]);
             }
             printf("'\n");
+#endif
 
             /* FIXME: register header value */
             return 0;
         }
     }
 
+#ifdef HTTP_STANDALONE
     printf("                 ===> %sunknown header key%s\n",
            ANSI_RED, ANSI_RESET);
+#endif
+    return 0;
+}
+
+/*
+ * Check if a request with complete headers asks for an HTTP/2 upgrade:
+ * HTTP/1.1, 'Upgrade: h2c' and a HTTP2-Settings header.
+ */
+static int h2c_upgrade(struct mk_http_parser *req)
+{
+    char *p;
+    char *end;
+    char *token;
+    struct mk_http_header *header;
+
+    header = &req->headers[MK_HEADER_UPGRADE];
+    if (header->type != MK_HEADER_UPGRADE ||
+        req->headers[MK_HEADER_HTTP2_SETTINGS].type !=
+        MK_HEADER_HTTP2_SETTINGS ||
+        req->protocol.len != 8 ||
+        strncmp(req->protocol.data, "HTTP/1.1", 8) != 0) {
+        return 0;
+    }
+
+    /* Upgrade is a list of protocols */
+    p   = header->val.data;
+    end = p + header->val.len;
+    while (p < end) {
+        while (p < end && (*p == ' ' || *p == ',')) {
+            p++;
+        }
+        token = p;
+        while (p < end && *p != ' ' && *p != ',') {
+            p++;
+        }
+        if (p - token == 3 && strncasecmp(token, "h2c", 3) == 0) {
+            return 1;
+        }
+    }
+
     return 0;
 }
 
@@ -162,6 +246,24 @@ int mk_http_parser(struct mk_http_parser *req, char *buffer, int len)
     int limit;
 
     limit = len + req->i;
+
+    /* PROXY LEVEL: the preamble is parsed as a whole once it's complete */
+    if (req->level == REQ_LEVEL_PROXY) {
+        ret = mk_http_proxy_parse(&req->proxy, buffer, limit);
+        if (ret == -1) {
+            return MK_HTTP_ERROR;
+        }
+        else if (ret == 0) {
+            req->i = limit;
+            return MK_HTTP_PENDING;
+        }
+
+        req->level  = REQ_LEVEL_FIRST;
+        req->status = MK_ST_REQ_METHOD;
+        req->i      = ret;
+        req->start  = ret;
+    }
+
     for (i = req->i; i < limit; req->i++, req->chars++, i++) {
         /* FIRST LINE LEVEL: Method, URI & Protocol */
         if (req->level == REQ_LEVEL_FIRST) {
@@ -170,9 +272,19 @@ int mk_http_parser(struct mk_http_parser *req, char *buffer, int len)
                 if (buffer[i] == ' ') {
                     mark_end();
                     req->status = MK_ST_REQ_URI;
-                    if (req->end < 2) {
+                    if (field_len() < 2) {
                         return MK_HTTP_ERROR;
                     }
+
+                    /* HTTP/2 with prior knowledge, match the whole preface */
+                    if (field_len() == 3 &&
+                        strncmp(buffer + req->start, h2_preface, 3) == 0) {
+                        req->status = MK_ST_REQ_H2_PREFACE;
+                        continue;
+                    }
+
+                    mark_field(req->method);
+                    fp_field();
                     parse_next();
                 }
                 break;
@@ -183,11 +295,15 @@ int mk_http_parser(struct mk_http_parser *req, char *buffer, int len)
                     if (field_len() < 1) {
                         return MK_HTTP_ERROR;
                     }
+                    mark_field(req->uri);
+                    fp_field();
                     parse_next();
                 }
                 else if (buffer[i] == '?') {
                     mark_end();
                     req->status = MK_ST_REQ_QUERY_STRING;
+                    mark_field(req->uri);
+                    fp_field();
                     parse_next();
                 }
                 break;
@@ -195,15 +311,27 @@ int mk_http_parser(struct mk_http_parser *req, char *buffer, int len)
                 if (buffer[i] == ' ') {
                     mark_end();
                     req->status = MK_ST_REQ_PROT_VERSION;
+                    mark_field(req->query_string);
+                    fp_field();
                     parse_next();
                 }
                 break;
+            case MK_ST_REQ_H2_PREFACE:                  /* HTTP/2 preface */
+                if (buffer[i] != h2_preface[i - req->start]) {
+                    return MK_HTTP_ERROR;
+                }
+                if (i - req->start == H2_PREFACE_LEN - 1) {
+                    req->body_start = req->i = i + 1;
+                    return MK_HTTP_H2_PREFACE;
+                }
+                break;
             case MK_ST_REQ_PROT_VERSION:                /* Protocol Version */
                 if (buffer[i] == '\r') {
                     mark_end();
                     if (field_len() != 8) {
                         return MK_HTTP_ERROR;
                     }
+                    mark_field(req->protocol);
                     req->status = MK_ST_FIRST_FINALIZING;
                     continue;
                 }
@@ -219,6 +347,8 @@ int mk_http_parser(struct mk_http_parser *req, char *buffer, int len)
                 break;
             case MK_ST_BLOCK_END:
                 if (buffer[i] == '\n') {
+                    req->body_start = i + 1;
+                    fp_final();
                     return MK_HTTP_OK;
                 }
                 else {
@@ -272,11 +402,15 @@ int mk_http_parser(struct mk_http_parser *req, char *buffer, int len)
                         req->header_min = MK_HEADER_COOKIE;
                         req->header_max = MK_HEADER_CONTENT_TYPE;
                         break;
+                    case 'E':
+                        header_scope_eq(req, MK_HEADER_EXPECT);
+                        break;
                     case 'I':
                         header_scope_eq(req, MK_HEADER_IF_MODIFIED_SINCE);
                         break;
                     case 'H':
-                        header_scope_eq(req, MK_HEADER_HOST);
+                        req->header_min = MK_HEADER_HOST;
+                        req->header_max = MK_HEADER_HTTP2_SETTINGS;
                         break;
                     case 'L':
                         req->header_min = MK_HEADER_LAST_MODIFIED;
@@ -287,7 +421,11 @@ int mk_http_parser(struct mk_http_parser *req, char *buffer, int len)
                         req->header_max = MK_HEADER_RANGE;
                         break;
                     case 'U':
-                        header_scope_eq(req, MK_HEADER_USER_AGENT);
+                        req->header_min = MK_HEADER_UPGRADE;
+                        req->header_max = MK_HEADER_USER_AGENT;
+                        break;
+                    case 'X':
+                        header_scope_eq(req, MK_HEADER_X_REQUEST_ID);
                         break;
                     default:
                         req->header_key = -1;
@@ -367,6 +505,25 @@ int mk_http_parser(struct mk_http_parser *req, char *buffer, int len)
             if (buffer[i] == '\n') {
                 req->level = REQ_LEVEL_BODY;
                 req->chars = -1;
+                req->body_start = i + 1;
+                fp_final();
+                req->h2c = h2c_upgrade(req);
+
+                /*
+                 * Headers are complete and a body is expected, if the
+                 * caller asked for it report it once so it can take
+                 * decisions before the body arrives. Body bytes already
+                 * in the buffer are accounted here, next calls continues
+                 * from the body start.
+                 */
+                if (req->notify_headers && req->header_content_length > 0) {
+                    req->start = req->i = i + 1;
+                    req->body_received += (limit - req->i);
+                    if (req->body_received >= req->header_content_length) {
+                        return request_complete();
+                    }
+                    return MK_HTTP_HEADERS;
+                }
                 parse_next();
             }
             else {
@@ -383,20 +540,20 @@ int mk_http_parser(struct mk_http_parser *req, char *buffer, int len)
             if (req->header_content_length > 0) {
                 req->body_received += (limit - i);
 
-                if (req->body_received == req->header_content_length) {
-                    return MK_HTTP_OK;
+                if (req->body_received >= req->header_content_length) {
+                    return request_complete();
                 }
                 else {
                     return MK_HTTP_PENDING;
                 }
             }
-            return MK_HTTP_OK;
+            return request_complete();
         }
     }
 
     if (req->level == REQ_LEVEL_FIRST) {
         if (req->status == MK_ST_REQ_METHOD) {
-            if (req->i > 10) {
+            if (req->i - req->start > 10) {
                 return MK_HTTP_ERROR;
             }
             else {
@@ -418,8 +575,8 @@ int mk_http_parser(struct mk_http_parser *req, char *buffer, int len)
     else if (req->level == REQ_LEVEL_BODY) {
         if (req->header_content_length > 0) {
             req->body_received += (limit - i);
-            if (req->header_content_length == req->body_received) {
-                return MK_HTTP_OK;
+            if (req->body_received >= req->header_content_length) {
+                return request_complete();
             }
             else {
                 return MK_HTTP_PENDING;
@@ -430,7 +587,7 @@ int mk_http_parser(struct mk_http_parser *req, char *buffer, int len)
             return MK_HTTP_PENDING;
         }
         else if (req->chars == 0) {
-            return MK_HTTP_OK;
+            return request_complete();
         }
         else {
         }
@@ -439,11 +596,279 @@ int mk_http_parser(struct mk_http_parser *req, char *buffer, int len)
     return MK_HTTP_PENDING;
 }
 
-struct mk_http_parser *mk_http_parser_new()
+/*
+ * Lookup the parameter 'name' inside a header value with the form
+ * 'token; key=value; key="value"', the output span points to the
+ * original value (without quotes).
+ */
+int mk_http_header_param(mk_ptr_t *val, const char *name, mk_ptr_t *out)
 {
-    struct mk_http_parser *req;
+    int len;
+    char *p;
+    char *end;
+    char *v;
+
+    len = strlen(name);
+    p   = val->data;
+    end = val->data + val->len;
+
+    while (p < end) {
+        /* jump to the next parameter */
+        p = memchr(p, ';', end - p);
+        if (!p) {
+            return -1;
+        }
+
+        p++;
+        while (p < end && (*p == ' ' || *p == '\t')) {
+            p++;
+        }
+
+        if (end - p <= len || p[len] != '=' ||
+            strncasecmp(p, name, len) != 0) {
+            continue;
+        }
+
+        v = p + len + 1;
+        if (v < end && *v == '"') {
+            v++;
+            p = memchr(v, '"', end - v);
+            if (!p) {
+                return -1;
+            }
+        }
+        else {
+            p = v;
+            while (p < end && *p != ';' && *p != ' ' && *p != '\t') {
+                p++;
+            }
+        }
+
+        out->data = v;
+        out->len  = p - v;
+        return 0;
+    }
+
+    return -1;
+}
+
+static int proxy_port(char *p, char *end)
+{
+    int port = 0;
+
+    if (p == end || end - p > 5) {
+        return -1;
+    }
+    while (p < end) {
+        if (*p < '0' || *p > '9') {
+            return -1;
+        }
+        port = (port * 10) + (*p++ - '0');
+    }
+    return (port > 65535) ? -1 : port;
+}
+
+/* PROXY protocol v1: 'PROXY TCP4 SRC DST SPORT DPORT\r\n' */
+static int proxy_v1(struct mk_http_proxy *proxy, char *buffer, int len)
+{
+    int i;
+    int n;
+    char *p;
+    char *end;
+    char *field[5];
+    char *field_end[5];
+    char addr[INET6_ADDRSTRLEN];
+
+    end = memchr(buffer, '\n', len < MK_PROXY_V1_MAX ? len : MK_PROXY_V1_MAX);
+    if (!end) {
+        return (len < MK_PROXY_V1_MAX) ? 0 : -1;
+    }
+    if (end[-1] != '\r') {
+        return -1;
+    }
+
+    proxy->version = 1;
+    proxy->length  = (end - buffer) + 1;
+    end--;
+
+    /* protocol */
+    p = buffer + 6;
+    if (end - p >= 7 && strncmp(p, "UNKNOWN", 7) == 0) {
+        proxy->family = AF_UNSPEC;
+        return proxy->length;
+    }
+    else if (end - p >= 5 && strncmp(p, "TCP4 ", 5) == 0) {
+        proxy->family = AF_INET;
+    }
+    else if (end - p >= 5 && strncmp(p, "TCP6 ", 5) == 0) {
+        proxy->family = AF_INET6;
+    }
+    else {
+        return -1;
+    }
+
+    /* source, destination, source port and destination port */
+    p += 5;
+    for (i = 0; i < 4; i++) {
+        field[i] = p;
+        while (p < end && *p != ' ') {
+            p++;
+        }
+        field_end[i] = p;
+        if ((i < 3 && p == end) || (i == 3 && p != end)) {
+            return -1;
+        }
+        p++;
+    }
+
+    for (i = 0; i < 2; i++) {
+        n = field_end[i] - field[i];
+        if (n >= sizeof(addr)) {
+            return -1;
+        }
+        memcpy(addr, field[i], n);
+        addr[n] = '\0';
+        if (inet_pton(proxy->family, addr,
+                      i == 0 ? proxy->src_addr : proxy->dst_addr) != 1) {
+            return -1;
+        }
+    }
+
+    proxy->src_port = proxy_port(field[2], field_end[2]);
+    proxy->dst_port = proxy_port(field[3], field_end[3]);
+    if (proxy->src_port == -1 || proxy->dst_port == -1) {
+        return -1;
+    }
+
+    return proxy->length;
+}
+
+/* PROXY protocol v2: signature, version/command, family, length */
+static int proxy_v2(struct mk_http_proxy *proxy, char *buffer, int len)
+{
+    int size;
+    int alen;
+    int inet;
+    unsigned char *p = (unsigned char *) buffer;
+
+    if (len < 16) {
+        return 0;
+    }
+
+    if ((p[12] >> 4) != 2 || (p[12] & 0x0f) > 1) {
+        return -1;
+    }
+
+    size = (p[14] << 8) | p[15];
+    if (len < 16 + size) {
+        return 0;
+    }
+
+    proxy->version = 2;
+    proxy->local   = ((p[12] & 0x0f) == 0);
+    proxy->length  = 16 + size;
+
+    switch (p[13] >> 4) {
+    case 0x1:
+        proxy->family = AF_INET;
+        alen = 4;
+        break;
+    case 0x2:
+        proxy->family = AF_INET6;
+        alen = 16;
+        break;
+    case 0x3:
+        proxy->family = AF_UNIX;
+        alen = 108;
+        break;
+    default:
+        proxy->family = AF_UNSPEC;
+        alen = 0;
+    };
+
+    /* UNIX addresses are skipped, the ports only exists for INET/INET6 */
+    inet = (proxy->family == AF_INET || proxy->family == AF_INET6);
+    if (size < alen * 2 + (inet ? 4 : 0)) {
+        return -1;
+    }
+
+    p += 16;
+    if (inet) {
+        memcpy(proxy->src_addr, p, alen);
+        memcpy(proxy->dst_addr, p + alen, alen);
+        p += alen * 2;
+        proxy->src_port = (p[0] << 8) | p[1];
+        proxy->dst_port = (p[2] << 8) | p[3];
+        p += 4;
+    }
+    else {
+        p += alen * 2;
+    }
+
+    /* a LOCAL command does not carry addresses we can trust */
+    if (proxy->local) {
+        proxy->family = AF_UNSPEC;
+    }
+
+    proxy->tlv.data = (char *) p;
+    proxy->tlv.len  = (buffer + proxy->length) - (char *) p;
+
+    return proxy->length;
+}
+
+/*
+ * Parse a PROXY protocol preamble at the buffer start. Returns the preamble
+ * length, 0 if more data is needed or -1 on error.
+ */
+int mk_http_proxy_parse(struct mk_http_proxy *proxy, char *buffer, int len)
+{
+    static const char v2_sig[] = "\r\n\r\n\0\r\nQUIT\n";
+
+    memset(proxy, '\0', sizeof(struct mk_http_proxy));
+
+    if (len >= 1 && buffer[0] == 'P') {
+        if (strncmp(buffer, "PROXY ", len < 6 ? len : 6) != 0) {
+            return -1;
+        }
+        return (len < 6) ? 0 : proxy_v1(proxy, buffer, len);
+    }
+
+    if (memcmp(buffer, v2_sig, len < MK_PROXY_V2_SIG ? len : MK_PROXY_V2_SIG)) {
+        return -1;
+    }
+    return (len < MK_PROXY_V2_SIG) ? 0 : proxy_v2(proxy, buffer, len);
+}
+
+/* Lookup a v2 TLV by type, returns 0 if found or -1 */
+int mk_http_proxy_tlv(struct mk_http_proxy *proxy, int type, mk_ptr_t *val)
+{
+    int size;
+    unsigned char *p;
+    unsigned char *end;
+
+    p   = (unsigned char *) proxy->tlv.data;
+    end = p + proxy->tlv.len;
+
+    while (end - p >= 3) {
+        size = (p[1] << 8) | p[2];
+        if (end - p < 3 + size) {
+            return -1;
+        }
+        if (p[0] == type) {
+            val->data = (char *) p + 3;
+            val->len  = size;
+            return 0;
+        }
+        p += 3 + size;
+    }
+
+    return -1;
+}
+
+void mk_http_parser_init(struct mk_http_parser *req)
+{
+    int i;
 
-    req = malloc(sizeof(struct mk_http_parser));
     req->i      = 0;
     req->level  = REQ_LEVEL_FIRST;
     req->status = MK_ST_REQ_METHOD;
@@ -456,8 +881,45 @@ struct mk_http_parser *mk_http_parser_new()
     req->header_min = -1;
     req->header_max = -1;
     req->header_sep = -1;
+    req->body_start     = -1;
+    req->h2c            = 0;
+    req->notify_headers = 0;
+    req->method.data       = NULL;
+    req->method.len        = 0;
+    req->uri.data          = NULL;
+    req->uri.len           = 0;
+    req->query_string.data = NULL;
+    req->query_string.len  = 0;
+    req->protocol.data     = NULL;
+    req->protocol.len      = 0;
+    memset(&req->proxy, '\0', sizeof(struct mk_http_proxy));
+
+    /* fingerprint: method, URI and Host by default */
+    req->fp_mask     = MK_HTTP_FP_BIT(MK_HEADER_HOST);
+    req->fp_line     = MK_HTTP_HASH64_INIT;
+    req->fp_headers  = 0;
+    req->fingerprint = 0;
     req->body_received  = 0;
     req->header_content_length = -1;
 
+    for (i = 0; i < MK_HEADER_SIZEOF; i++) {
+        req->headers[i].type     = -1;
+        req->headers[i].key.data = NULL;
+        req->headers[i].key.len  = 0;
+        req->headers[i].val.data = NULL;
+        req->headers[i].val.len  = 0;
+    }
+}
+
+struct mk_http_parser *mk_http_parser_new()
+{
+    struct mk_http_parser *req;
+
+    req = malloc(sizeof(struct mk_http_parser));
+    if (!req) {
+        return NULL;
+    }
+    mk_http_parser_init(req);
+
     return req;
 }
@@ -18,6 +18,7 @@
  */
 
 #include <stdio.h>
+#include <stdint.h>
 
 #ifndef MK_HTTP_H
 #define MK_HTTP_H
@@ -32,10 +33,21 @@ typedef struct
 #define MK_HTTP_PENDING -10  /* cannot complete until more data arrives */
 #define MK_HTTP_ERROR    -1  /* found an error when parsing the string */
 #define MK_HTTP_OK        0
+#define MK_HTTP_HEADERS   1  /* headers complete, the body is pending,
+                                only reported if 'notify_headers' is set */
+
+/*
+ * Protocol switch. After a preface HTTP/2 data starts at body_start, after
+ * an upgrade request it starts once the request body ends, at body_start
+ * plus header_content_length (if set).
+ */
+#define MK_HTTP_H2_PREFACE   2  /* HTTP/2 connection preface, prior knowledge */
+#define MK_HTTP_H2C_UPGRADE  3  /* complete request with 'Upgrade: h2c'      */
 
 /* Request levels
  * ==============
  *
+ * 0. PROXY (optional)   : PROXY protocol v1 or v2 preamble
  * 1. FIRST_LINE         : Method, URI (+ QS) + Protocol version + CRLF
  * 2. HEADERS (optional) : KEY, SEP, VALUE + CRLF
  * 3. BODY (option)      : data based on Content-Length or Chunked transfer encoding
@@ -46,7 +58,8 @@ enum {
     REQ_LEVEL_CONTINUE ,
     REQ_LEVEL_HEADERS  ,
     REQ_LEVEL_END      ,
-    REQ_LEVEL_BODY
+    REQ_LEVEL_BODY     ,
+    REQ_LEVEL_PROXY         /* set it after init to expect a preamble */
 };
 
 /* Statuses per levels */
@@ -56,6 +69,7 @@ enum {
     MK_ST_REQ_URI           ,
     MK_ST_REQ_QUERY_STRING  ,
     MK_ST_REQ_PROT_VERSION  ,
+    MK_ST_REQ_H2_PREFACE    ,
     MK_ST_FIRST_CONTINUE    ,
     MK_ST_FIRST_FINALIZING  ,    /* LEVEL_FIRST finalize the request */
     MK_ST_FIRST_COMPLETE    ,
@@ -81,19 +95,32 @@ enum {
     MK_HEADER_AUTHORIZATION         ,
     MK_HEADER_COOKIE                ,
     MK_HEADER_CONNECTION            ,
+    MK_HEADER_CONTENT_DISPOSITION   ,
     MK_HEADER_CONTENT_LENGTH        ,
     MK_HEADER_CONTENT_RANGE         ,
     MK_HEADER_CONTENT_TYPE          ,
+    MK_HEADER_EXPECT                ,
     MK_HEADER_IF_MODIFIED_SINCE     ,
     MK_HEADER_HOST                  ,
+    MK_HEADER_HTTP2_SETTINGS        ,
     MK_HEADER_LAST_MODIFIED         ,
     MK_HEADER_LAST_MODIFIED_SINCE   ,
     MK_HEADER_REFERER               ,
     MK_HEADER_RANGE                 ,
+    MK_HEADER_UPGRADE               ,
     MK_HEADER_USER_AGENT            ,
+    MK_HEADER_X_REQUEST_ID          ,
     MK_HEADER_SIZEOF
 };
 
+/* Known headers table, indexed by MK_HEADER_* */
+struct header_entry {
+    int len;
+    const char name[32];
+};
+
+extern struct header_entry headers_table[];
+
 struct mk_http_header {
     int type;
     mk_ptr_t key;
@@ -101,6 +128,38 @@ struct mk_http_header {
 };
 
 
+/*
+ * PROXY protocol
+ * ==============
+ *
+ * Preamble sent by load balancers before the request, when the parser
+ * starts on REQ_LEVEL_PROXY it's required. Addresses are stored in
+ * network byte order for both versions, 'family' takes the AF_* values.
+ */
+#define MK_PROXY_V1_MAX    107     /* max v1 line length including CRLF */
+#define MK_PROXY_V2_SIG     12
+
+/* v2 TLV types */
+#define MK_PROXY_TLV_ALPN        0x01
+#define MK_PROXY_TLV_AUTHORITY   0x02
+#define MK_PROXY_TLV_CRC32C      0x03
+#define MK_PROXY_TLV_NOOP        0x04
+#define MK_PROXY_TLV_UNIQUE_ID   0x05
+#define MK_PROXY_TLV_SSL         0x20
+#define MK_PROXY_TLV_NETNS       0x30
+
+struct mk_http_proxy {
+    int version;      /* 1 or 2                              */
+    int local;        /* v2 LOCAL command, no addresses      */
+    int family;       /* AF_INET, AF_INET6, AF_UNIX or AF_UNSPEC */
+    int length;       /* preamble length                     */
+    int src_port;
+    int dst_port;
+    unsigned char src_addr[16];
+    unsigned char dst_addr[16];
+    mk_ptr_t tlv;     /* v2 TLVs area                        */
+};
+
 /* This structure is the 'Parser Context' */
 struct mk_http_parser {
     int i;
@@ -114,6 +173,27 @@ struct mk_http_parser {
     int end;
     int chars;
 
+    /* request line fields, set once they are marked */
+    mk_ptr_t method;
+    mk_ptr_t uri;
+    mk_ptr_t query_string;
+    mk_ptr_t protocol;
+
+    /* set when a request with complete headers asks for h2c */
+    int h2c;
+
+    /*
+     * Optional, set it after the parser initialization to get
+     * MK_HTTP_HEADERS when the headers are complete and the body is not.
+     */
+    int notify_headers;
+
+    /*
+     * Offset where the body starts (or where the next pipelined request
+     * starts if there is no body), it's set once the headers ends.
+     */
+    int body_start;
+
     /* it stores the numeric value of Content-Length header */
     long body_received;
     long header_content_length;
@@ -125,11 +205,65 @@ struct mk_http_parser {
     int header_min;
     int header_max;
 
+    /*
+     * Request fingerprint: a hash of method, URI and query string, plus
+     * the headers selected by 'fp_mask' (MK_HTTP_FP_BIT()). Fields are
+     * hashed when they are marked, the final value is set in
+     * 'fingerprint' once the headers ends.
+     */
+    unsigned int fp_mask;
+    uint64_t fp_line;
+    uint64_t fp_headers;
+    uint64_t fingerprint;
+
+    /* PROXY protocol preamble, if REQ_LEVEL_PROXY was set */
+    struct mk_http_proxy proxy;
+
     struct mk_http_header headers[MK_HEADER_SIZEOF];
 };
 
+#define MK_HTTP_FP_BIT(header)  (1u << (header))
+
+/*
+ * FNV-1a hash, used by the lookup tables built on top of the parser. It
+ * can be chained over many spans passing the previous result as 'h',
+ * starting with MK_HTTP_HASH_INIT.
+ */
+#define MK_HTTP_HASH_INIT  2166136261u
+
+static inline unsigned int mk_http_hash(unsigned int h,
+                                        const char *data, unsigned long len)
+{
+    unsigned long i;
+
+    for (i = 0; i < len; i++) {
+        h ^= (unsigned char) data[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+/* 64 bits FNV-1a, same usage than mk_http_hash() */
+#define MK_HTTP_HASH64_INIT  14695981039346656037ull
+
+static inline uint64_t mk_http_hash64(uint64_t h,
+                                      const char *data, unsigned long len)
+{
+    unsigned long i;
+
+    for (i = 0; i < len; i++) {
+        h ^= (unsigned char) data[i];
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+void mk_http_parser_init(struct mk_http_parser *req);
 struct mk_http_parser *mk_http_parser_new();
 int mk_http_parser(struct mk_http_parser *req, char *buffer, int len);
+int mk_http_header_param(mk_ptr_t *val, const char *name, mk_ptr_t *out);
+int mk_http_proxy_parse(struct mk_http_proxy *proxy, char *buffer, int len);
+int mk_http_proxy_tlv(struct mk_http_proxy *proxy, int type, mk_ptr_t *val);
 
 
 #ifdef HTTP_STANDALONE
@@ -0,0 +1,245 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Monkey HTTP Server
+ *  ==================
+ *  Copyright 2001-2014 Monkey Software LLC <eduardo@monkey.io>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mk_http_response.h"
+
+#define CRLF  "\r\n"
+
+#define STATUS(code, reason)                                    \
+    [code - 100] = {                                            \
+        "HTTP/1.1 " #code " " reason CRLF,                      \
+        sizeof("HTTP/1.1 " #code " " reason CRLF) - 1           \
+    }
+
+/* Pre-rendered status lines, indexed by code - 100 */
+static const mk_ptr_t status_table[500] = {
+    STATUS(100, "Continue"),
+    STATUS(101, "Switching Protocols"),
+    STATUS(200, "OK"),
+    STATUS(201, "Created"),
+    STATUS(202, "Accepted"),
+    STATUS(203, "Non-Authoritative Information"),
+    STATUS(204, "No Content"),
+    STATUS(205, "Reset Content"),
+    STATUS(206, "Partial Content"),
+    STATUS(300, "Multiple Choices"),
+    STATUS(301, "Moved Permanently"),
+    STATUS(302, "Found"),
+    STATUS(303, "See Other"),
+    STATUS(304, "Not Modified"),
+    STATUS(305, "Use Proxy"),
+    STATUS(307, "Temporary Redirect"),
+    STATUS(308, "Permanent Redirect"),
+    STATUS(400, "Bad Request"),
+    STATUS(401, "Unauthorized"),
+    STATUS(402, "Payment Required"),
+    STATUS(403, "Forbidden"),
+    STATUS(404, "Not Found"),
+    STATUS(405, "Method Not Allowed"),
+    STATUS(406, "Not Acceptable"),
+    STATUS(407, "Proxy Authentication Required"),
+    STATUS(408, "Request Timeout"),
+    STATUS(409, "Conflict"),
+    STATUS(410, "Gone"),
+    STATUS(411, "Length Required"),
+    STATUS(412, "Precondition Failed"),
+    STATUS(413, "Payload Too Large"),
+    STATUS(414, "URI Too Long"),
+    STATUS(415, "Unsupported Media Type"),
+    STATUS(416, "Range Not Satisfiable"),
+    STATUS(417, "Expectation Failed"),
+    STATUS(421, "Misdirected Request"),
+    STATUS(426, "Upgrade Required"),
+    STATUS(428, "Precondition Required"),
+    STATUS(429, "Too Many Requests"),
+    STATUS(431, "Request Header Fields Too Large"),
+    STATUS(500, "Internal Server Error"),
+    STATUS(501, "Not Implemented"),
+    STATUS(502, "Bad Gateway"),
+    STATUS(503, "Service Unavailable"),
+    STATUS(504, "Gateway Timeout"),
+    STATUS(505, "HTTP Version Not Supported")
+};
+
+/* Per thread Date line: 'Date: Sun, 06 Nov 1994 08:49:37 GMT\r\n' */
+#define DATE_LINE_LEN  37
+
+static __thread time_t date_last = -1;
+static __thread char date_line[DATE_LINE_LEN + 1];
+
+static const char *wdays[] = {"Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"};
+static const char *months[] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun",
+                               "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+
+#define iov_add(resp, ptr, size)                                        \
+    resp->iov[resp->iov_n].iov_base = (void *) (ptr);                   \
+    resp->iov[resp->iov_n].iov_len  = (size);                           \
+    resp->iov_n++
+
+#define iov_check(resp, n)                                              \
+    if (resp->iov_n + (n) > MK_RESPONSE_IOV) {                          \
+        return -1;                                                      \
+    }
+
+static inline char *date_digits(char *p, int v, int n)
+{
+    while (n-- > 0) {
+        p[n] = '0' + (v % 10);
+        v /= 10;
+    }
+    return p;
+}
+
+static void date_render(time_t now)
+{
+    char *p = date_line;
+    struct tm tm;
+
+    gmtime_r(&now, &tm);
+
+    memcpy(p, "Date: ", 6);
+    memcpy(p + 6, wdays[tm.tm_wday], 3);
+    memcpy(p + 9, ", ", 2);
+    date_digits(p + 11, tm.tm_mday, 2);
+    p[13] = ' ';
+    memcpy(p + 14, months[tm.tm_mon], 3);
+    p[17] = ' ';
+    date_digits(p + 18, tm.tm_year + 1900, 4);
+    p[22] = ' ';
+    date_digits(p + 23, tm.tm_hour, 2);
+    p[25] = ':';
+    date_digits(p + 26, tm.tm_min, 2);
+    p[28] = ':';
+    date_digits(p + 29, tm.tm_sec, 2);
+    memcpy(p + 31, " GMT" CRLF, 6);
+
+    date_last = now;
+}
+
+void mk_http_response_init(struct mk_http_response *resp)
+{
+    resp->iov_n = 0;
+}
+
+/* Add the status line, returns -1 if the code is unknown */
+int mk_http_response_status(struct mk_http_response *resp, int code)
+{
+    const mk_ptr_t *status;
+
+    if (code < 100 || code > 599) {
+        return -1;
+    }
+
+    status = &status_table[code - 100];
+    if (!status->data) {
+        return -1;
+    }
+
+    iov_check(resp, 1);
+    iov_add(resp, status->data, status->len);
+    return 0;
+}
+
+/* Add the Date header, 'now' is usually time(NULL) */
+int mk_http_response_date(struct mk_http_response *resp, time_t now)
+{
+    iov_check(resp, 1);
+    if (now != date_last) {
+        date_render(now);
+    }
+    iov_add(resp, date_line, DATE_LINE_LEN);
+    return 0;
+}
+
+/* Add a known header (MK_HEADER_*) with the given value */
+int mk_http_response_header(struct mk_http_response *resp, int header,
+                            char *val, unsigned long len)
+{
+    struct header_entry *h;
+
+    if (header < 0 || header >= MK_HEADER_SIZEOF) {
+        return -1;
+    }
+
+    iov_check(resp, 3);
+    h = &headers_table[header];
+    iov_add(resp, h->name, h->len + 2);
+    iov_add(resp, val, len);
+    iov_add(resp, CRLF, 2);
+    return 0;
+}
+
+/* Echo a request header, e.g: X-Request-Id. Returns -1 if it's missing */
+int mk_http_response_echo(struct mk_http_response *resp,
+                          struct mk_http_parser *req, int header)
+{
+    struct mk_http_header *h;
+
+    if (header < 0 || header >= MK_HEADER_SIZEOF) {
+        return -1;
+    }
+
+    h = &req->headers[header];
+    if (h->type != header) {
+        return -1;
+    }
+    return mk_http_response_header(resp, header, h->val.data, h->val.len);
+}
+
+int mk_http_response_content_length(struct mk_http_response *resp,
+                                    long len)
+{
+    int n;
+    char *p;
+
+    if (len < 0) {
+        return -1;
+    }
+
+    /* digits are rendered backwards at the end of the scratch buffer */
+    p = resp->content_length + sizeof(resp->content_length);
+    do {
+        *--p = '0' + (len % 10);
+        len /= 10;
+    } while (len > 0);
+    n = (resp->content_length + sizeof(resp->content_length)) - p;
+
+    return mk_http_response_header(resp, MK_HEADER_CONTENT_LENGTH, p, n);
+}
+
+/* Add a complete header line, 'line' must end with CRLF */
+int mk_http_response_line(struct mk_http_response *resp,
+                          char *line, unsigned long len)
+{
+    iov_check(resp, 1);
+    iov_add(resp, line, len);
+    return 0;
+}
+
+/* Finish the head, returns the number of iovec entries to write */
+int mk_http_response_end(struct mk_http_response *resp)
+{
+    iov_check(resp, 1);
+    iov_add(resp, CRLF, 2);
+    return resp->iov_n;
+}
@@ -0,0 +1,59 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Monkey HTTP Server
+ *  ==================
+ *  Copyright 2001-2014 Monkey Software LLC <eduardo@monkey.io>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <time.h>
+#include <sys/uio.h>
+
+#include "mk_http_parser.h"
+
+#ifndef MK_HTTP_RESPONSE_H
+#define MK_HTTP_RESPONSE_H
+
+#define MK_RESPONSE_IOV   64
+
+/*
+ * Response head builder
+ * =====================
+ *
+ * The head is composed as an iovec array ready for writev(2): entries
+ * points to pre-rendered static strings (status lines, headers names
+ * from headers_table[]), to the caller values or to the per thread Date
+ * line, nothing is copied. The Date line is refreshed once per second, so
+ * the head must be written before the thread builds a new one.
+ */
+struct mk_http_response {
+    int iov_n;
+    struct iovec iov[MK_RESPONSE_IOV];
+    char content_length[24];
+};
+
+void mk_http_response_init(struct mk_http_response *resp);
+int mk_http_response_status(struct mk_http_response *resp, int code);
+int mk_http_response_date(struct mk_http_response *resp, time_t now);
+int mk_http_response_header(struct mk_http_response *resp, int header,
+                            char *val, unsigned long len);
+int mk_http_response_echo(struct mk_http_response *resp,
+                          struct mk_http_parser *req, int header);
+int mk_http_response_content_length(struct mk_http_response *resp,
+                                    long len);
+int mk_http_response_line(struct mk_http_response *resp,
+                          char *line, unsigned long len);
+int mk_http_response_end(struct mk_http_response *resp);
+
+#endif /* MK_HTTP_RESPONSE_H */
@@ -20,8 +20,18 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
 
 #include "mk_http_parser.h"
+#include "mk_http_multipart.h"
+#include "mk_http_cookie.h"
+#include "mk_http_accept.h"
+#include "mk_http_microcache.h"
+#include "mk_http_desc.h"
+#include "mk_http_date.h"
+#include "mk_http_response.h"
+#include "mk_http_log.h"
 
 int t_succeed;
 int t_failed;
@@ -66,6 +76,12 @@ void test(char *id, char *buf, int res)
             status = TEST_OK;
         }
     }
+    else if (res == MK_HTTP_HEADERS || res == MK_HTTP_H2_PREFACE ||
+             res == MK_HTTP_H2C_UPGRADE) {
+        if (ret == res) {
+            status = TEST_OK;
+        }
+    }
 
     if (status == TEST_OK) {
         printf("%s[%s%s%s______OK_____%s%s]%s  ",
@@ -88,6 +104,15 @@ void test(char *id, char *buf, int res)
     case MK_HTTP_PENDING:
         printf("MK_HTTP_PENDING");
         break;
+    case MK_HTTP_HEADERS:
+        printf("MK_HTTP_HEADERS");
+        break;
+    case MK_HTTP_H2_PREFACE:
+        printf("MK_HTTP_H2_PREFACE");
+        break;
+    case MK_HTTP_H2C_UPGRADE:
+        printf("MK_HTTP_H2C_UPGRADE");
+        break;
     };
 
     printf("%s got %s", ANSI_RESET, ANSI_BOLD);
@@ -108,6 +133,15 @@ void test(char *id, char *buf, int res)
     case MK_HTTP_PENDING:
         printf("MK_HTTP_PENDING");
         break;
+    case MK_HTTP_HEADERS:
+        printf("MK_HTTP_HEADERS");
+        break;
+    case MK_HTTP_H2_PREFACE:
+        printf("MK_HTTP_H2_PREFACE");
+        break;
+    case MK_HTTP_H2C_UPGRADE:
+        printf("MK_HTTP_H2C_UPGRADE");
+        break;
     };
 
     printf("%s]", ANSI_RESET);
@@ -129,8 +163,215 @@ void test(char *id, char *buf, int res)
     free(req);
 }
 
+/* Print the result of a test not based on the parser status */
+void check(char *id, int ok)
+{
+    if (ok) {
+        printf("%s[%s%s%s______OK_____%s%s]%s  ",
+               ANSI_BOLD, ANSI_RESET, ANSI_BOLD, ANSI_GREEN,
+               ANSI_RESET, ANSI_BOLD, ANSI_RESET);
+        t_succeed++;
+    }
+    else {
+        printf("%s[%s%s%s____FAIL_____%s%s]%s  ",
+               ANSI_BOLD, ANSI_RESET, ANSI_BOLD, ANSI_RED,
+               ANSI_RESET, ANSI_BOLD, ANSI_RESET);
+        t_failed++;
+    }
+    printf("%s[%sTEST %s]\n\n", ANSI_BOLD, ANSI_RESET, id);
+
+    if (!ok) {
+        exit(1);
+    }
+}
+
+/*
+ * Feed a multipart body in chunks of 'chunk' bytes, keeping only the
+ * unconsumed bytes between calls. Every part is written to 'out' as
+ * 'name=data;'.
+ */
+int test_multipart(char *type, char *body, int chunk, char *out)
+{
+    int ret;
+    int len;
+    int off = 0;
+    int have = 0;
+    char buf[256];
+    char *head = "POST / HTTP/1.0\r\nContent-Type: %s\r\n\r\n";
+    char req_buf[256];
+    mk_ptr_t name;
+    struct mk_http_header *h;
+    struct mk_http_multipart mp;
+    struct mk_http_parser *req = mk_http_parser_new();
+
+    len = snprintf(req_buf, sizeof(req_buf), head, type);
+    ret = mk_http_parser(req, req_buf, len);
+    if (ret != MK_HTTP_OK || mk_http_multipart_init(&mp, req) != 0) {
+        free(req);
+        return MK_HTTP_ERROR;
+    }
+    free(req);
+
+    *out = '\0';
+    len = strlen(body);
+    while (1) {
+        if (off < len) {
+            ret = (len - off < chunk) ? len - off : chunk;
+            memcpy(buf + have, body + off, ret);
+            have += ret;
+            off  += ret;
+        }
+
+        ret = mk_http_multipart_parse(&mp, buf, have);
+        if (ret == MK_HTTP_ERROR || ret == MK_MP_DONE) {
+            return ret;
+        }
+        else if (ret == MK_MP_PART_HEADERS) {
+            h = &mp.part.headers[MK_HEADER_CONTENT_DISPOSITION];
+            if (h->type != MK_HEADER_CONTENT_DISPOSITION ||
+                mk_http_header_param(&h->val, "name", &name) != 0) {
+                return MK_HTTP_ERROR;
+            }
+            strncat(out, name.data, name.len);
+            strcat(out, "=");
+        }
+        else if (ret == MK_MP_PART_DATA) {
+            strncat(out, mp.data.data, mp.data.len);
+        }
+        else if (ret == MK_MP_PART_END) {
+            strcat(out, ";");
+        }
+        else if (ret == MK_HTTP_PENDING && off >= len) {
+            return ret;
+        }
+
+        have -= mp.consumed;
+        memmove(buf, buf + mp.consumed, have);
+    }
+}
+
+/* Lookup a cookie and compare its value */
+int test_cookie(struct mk_http_cookie_index *idx, char *name, char *val)
+{
+    int ret;
+    mk_ptr_t v;
+
+    ret = mk_http_cookie_lookup(idx, name, strlen(name), &v);
+    if (ret != 0) {
+        return (val == NULL);
+    }
+    return (val && v.len == strlen(val) && strncmp(v.data, val, v.len) == 0);
+}
+
+/* Parse a request with the given Accept* header and choose the best item */
+int test_accept(char *header, unsigned int supported)
+{
+    int len;
+    int ret;
+    char buf[256];
+    struct mk_http_accept acc;
+    struct mk_http_parser *req = mk_http_parser_new();
+
+    len = snprintf(buf, sizeof(buf), "GET / HTTP/1.0\r\n%s\r\n", header);
+    mk_http_parser(req, buf, len);
+    if (strncmp(header, "Accept:", 7) == 0 || strcmp(header, "") == 0) {
+        mk_http_accept_media(req, &acc);
+    }
+    else {
+        mk_http_accept_encoding(req, &acc);
+    }
+    ret = mk_http_accept_best(&acc, supported);
+    free(req);
+
+    return ret;
+}
+
+/* Parse a request and return its fingerprint */
+uint64_t test_fingerprint(char *buf, unsigned int mask)
+{
+    uint64_t fp;
+    struct mk_http_parser *req = mk_http_parser_new();
+
+    if (mask) {
+        req->fp_mask = mask;
+    }
+    mk_http_parser(req, buf, strlen(buf));
+    fp = req->fingerprint;
+    free(req);
+
+    return fp;
+}
+
+/*
+ * Parse a request starting with a PROXY protocol preamble, one byte per
+ * call. The parser context is returned in 'out'.
+ */
+int test_proxy(char *buf, int len, struct mk_http_parser *out)
+{
+    int i;
+    int ret = MK_HTTP_PENDING;
+    struct mk_http_parser *req = mk_http_parser_new();
+
+    req->level = REQ_LEVEL_PROXY;
+    for (i = 0; i < len; i++) {
+        ret = mk_http_parser(req, buf, 1);
+        if (ret == MK_HTTP_ERROR) {
+            break;
+        }
+    }
+    *out = *req;
+    free(req);
+
+    return ret;
+}
+
+/* Parse a date string */
+time_t test_date(char *str)
+{
+    return mk_http_date_parse(str, strlen(str));
+}
+
+/* Flatten the response iovec array on 'out' */
+void test_response(struct mk_http_response *resp, char *out)
+{
+    int i;
+
+    *out = '\0';
+    for (i = 0; i < resp->iov_n; i++) {
+        strncat(out, resp->iov[i].iov_base, resp->iov[i].iov_len);
+    }
+}
+
+/* Parse 'buf', log it and read back the flushed record on 'out' */
+int test_log(struct mk_http_log *log, int fd, char *buf, char *out, int size)
+{
+    int n;
+    struct mk_http_parser *req;
+
+    req = mk_http_parser_new();
+    mk_http_parser(req, buf, strlen(buf));
+    n = mk_http_log_request(log, req, 1416231513, 200, 1024);
+    free(req);
+    if (n != 0) {
+        return -1;
+    }
+
+    mk_http_log_flush(log);
+    n = read(fd, out, size - 1);
+    if (n < 0) {
+        return -1;
+    }
+    out[n] = '\0';
+    return n;
+}
+
 int main()
 {
+    int i;
+    int ret;
+    int len;
+    char out[256];
+
     /* Test First Line */
     char *r10 = "GET / HTTP/1.0\r\n\r\n";
     char *r11 = "GET/HTTP/1.0\r\n\r\n";
@@ -244,6 +485,499 @@ int main()
     TEST(r206, MK_HTTP_OK);
     TEST(r207, MK_HTTP_PENDING);
 
+    /* Test the headers notification before the body */
+    char *r210 = "POST / HTTP/1.0\r\n"
+                 "Expect: 100-continue\r\n"
+                 "Content-Length: 10\r\n\r\n"
+                 "0123456789";
+    struct mk_http_parser *req;
+
+    req = mk_http_parser_new();
+    req->notify_headers = 1;
+    len = strlen(r210);
+    ret = mk_http_parser(req, r210, len - 8);
+    check("r210 headers", ret == MK_HTTP_HEADERS &&
+          req->body_start == len - 10 && req->body_received == 2 &&
+          req->headers[MK_HEADER_EXPECT].type == MK_HEADER_EXPECT);
+    ret = mk_http_parser(req, r210, 3);
+    check("r210 pending", ret == MK_HTTP_PENDING && req->body_received == 5);
+    ret = mk_http_parser(req, r210, 5);
+    check("r210 ok", ret == MK_HTTP_OK);
+    free(req);
+
+    /* a complete body is not reported as pending */
+    req = mk_http_parser_new();
+    req->notify_headers = 1;
+    ret = mk_http_parser(req, r200, strlen(r200));
+    check("r200 one shot ok", ret == MK_HTTP_OK &&
+          req->body_start + req->header_content_length == strlen(r200));
+    free(req);
+
+    /* without notification a pending body keeps the baseline status */
+    req = mk_http_parser_new();
+    ret = mk_http_parser(req, r210, len - 8);
+    check("r210 no notify", ret == MK_HTTP_PENDING &&
+          req->body_start == len - 10);
+    free(req);
+
+    req = mk_http_parser_new();
+    ret = mk_http_parser(req, r10, strlen(r10));
+    check("r10 body start", ret == MK_HTTP_OK &&
+          req->body_start == strlen(r10));
+    free(req);
+
+    /* Test HTTP/2 preface and h2c upgrades */
+    char *h1 = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+    char *h2 = "PRI * HTTP/2.0\r\n\r\nSX\r\n\r\n";
+    char *h3 = "PRI * HTTP/2.0\r\n\r\n";
+    char *h4 = "GET / HTTP/1.1\r\nHost: x\r\n"
+        "Connection: Upgrade, HTTP2-Settings\r\n"
+        "Upgrade: websocket, h2c\r\nHTTP2-Settings: AAMAAABkAAQAAP__\r\n\r\n";
+    char *h5 = "GET / HTTP/1.1\r\nUpgrade: h2c\r\n\r\n";
+    char *h6 = "GET / HTTP/1.0\r\nUpgrade: h2c\r\n"
+        "HTTP2-Settings: AAMAAABkAAQAAP__\r\n\r\n";
+    char *h7 = "POST / HTTP/1.1\r\nUpgrade: h2c\r\n"
+        "HTTP2-Settings: AAMAAABkAAQAAP__\r\nContent-Length: 2\r\n\r\nab";
+
+    TEST(h1, MK_HTTP_H2_PREFACE);
+    TEST(h2, MK_HTTP_ERROR);
+    TEST(h3, MK_HTTP_PENDING);
+    TEST(h4, MK_HTTP_H2C_UPGRADE);
+    TEST(h5, MK_HTTP_OK);
+    TEST(h6, MK_HTTP_OK);
+    TEST(h7, MK_HTTP_H2C_UPGRADE);
+
+    /* the upgrade body is HTTP/1.1, HTTP/2 data starts after it */
+    req = mk_http_parser_new();
+    ret = mk_http_parser(req, h7, strlen(h7));
+    check("h7 h2 offset", ret == MK_HTTP_H2C_UPGRADE &&
+          req->body_start + req->header_content_length == strlen(h7));
+    free(req);
+
+    char h8[64];
+    sprintf(h8, "%s%s", h1, "\x04\x01\x02\x03");
+    req = mk_http_parser_new();
+    ret = mk_http_parser(req, h8, strlen(h8));
+    check("h8 preface offset", ret == MK_HTTP_H2_PREFACE &&
+          req->body_start == 24);
+    free(req);
+
+    /* Test multipart bodies, each one parsed in different chunk sizes */
+    char *m1 = "--XyZ\r\n"
+        "Content-Disposition: form-data; name=\"a\"\r\n\r\n"
+        "hello\r\n"
+        "--XyZ\r\n"
+        "Content-Disposition: form-data; name=\"f\"; filename=\"x\"\r\n"
+        "Content-Type: text/plain\r\n\r\n"
+        "--Xy\r\n--XyA\r\r\n-\r\n"
+        "--XyZ--\r\n";
+    char *m2 = "preamble\r\n--XyZ  \r\n"
+        "Content-Disposition: form-data; name=b\r\n\r\n"
+        "\r\n--XyZ--";
+    char *m3 = "--XyZ\r\n"
+        "Content-Disposition: form-data; name=\"a\"\r\n\r\n"
+        "unfinished";
+    char *m4 = "--XyZ\r\nContent-Disposition: form-data\r\r\n\r\n";
+
+    for (i = 1; i <= 64; i *= 2) {
+        ret = test_multipart("multipart/form-data; boundary=XyZ", m1, i, out);
+        check("m1", ret == MK_MP_DONE &&
+              strcmp(out, "a=hello;f=--Xy\r\n--XyA\r\r\n-;") == 0);
+
+        ret = test_multipart("multipart/form-data; boundary=\"XyZ\"", m2, i, out);
+        check("m2", ret == MK_MP_DONE && strcmp(out, "b=;") == 0);
+
+        ret = test_multipart("multipart/form-data; boundary=XyZ", m3, i, out);
+        check("m3", ret == MK_HTTP_PENDING && strcmp(out, "a=unfinished") == 0);
+
+        ret = test_multipart("multipart/form-data; boundary=XyZ", m4, i, out);
+        check("m4", ret == MK_HTTP_ERROR);
+    }
+
+    ret = test_multipart("multipart/form-data", m1, 1, out);
+    check("m5", ret == MK_HTTP_ERROR);
+
+    ret = test_multipart("text/plain; boundary=XyZ", m1, 1, out);
+    check("m6", ret == MK_HTTP_ERROR);
+
+    /* headers block starting with a LF after a pending delimiter */
+    ret = test_multipart("multipart/form-data; boundary=XyZ",
+                         "--XyZ\r\n\n\r\n\r", 7, out);
+    check("m7", ret == MK_HTTP_PENDING && out[0] == '\0');
+
+    /* Test cookies */
+    char *c1 = "GET / HTTP/1.0\r\n"
+        "Cookie: a=1; bb = 22 ;;c=\"3\";flag; e=; =x\r\n\r\n";
+    char c2[4096];
+    struct mk_http_cookie cookie;
+    struct mk_http_cookie_iter it;
+    struct mk_http_cookie_index idx;
+
+    req = mk_http_parser_new();
+    mk_http_parser(req, c1, strlen(c1));
+    mk_http_cookie_iter_init(&it, req);
+    out[0] = '\0';
+    while (mk_http_cookie_next(&it, &cookie) == 0) {
+        strncat(out, cookie.name.data, cookie.name.len);
+        strcat(out, "|");
+        strncat(out, cookie.val.data, cookie.val.len);
+        strcat(out, "|");
+    }
+    check("c1 iterator", strcmp(out, "a|1|bb|22|c|3|flag||e|||x|") == 0);
+
+    mk_http_cookie_index_init(&idx, req);
+    check("c1 lookup", test_cookie(&idx, "bb", "22") &&
+          test_cookie(&idx, "a", "1") && test_cookie(&idx, "flag", "") &&
+          test_cookie(&idx, "c", "3") && test_cookie(&idx, "z", NULL));
+    free(req);
+
+    /* more cookies than the index can hold, duplicated names */
+    len = sprintf(c2, "GET / HTTP/1.0\r\nCookie: ");
+    for (i = 0; i < MK_COOKIE_INDEX_MAX + 10; i++) {
+        len += sprintf(c2 + len, "k%i=v%i; ", i, i);
+    }
+    len += sprintf(c2 + len, "k1=dup\r\n\r\n");
+
+    req = mk_http_parser_new();
+    mk_http_parser(req, c2, len);
+    mk_http_cookie_index_init(&idx, req);
+    check("c2 lookup", test_cookie(&idx, "k0", "v0") &&
+          test_cookie(&idx, "k1", "v1") && test_cookie(&idx, "k70", "v70") &&
+          test_cookie(&idx, "k73", "v73") && test_cookie(&idx, "k74", NULL));
+    free(req);
+
+    req = mk_http_parser_new();
+    mk_http_parser(req, r10, strlen(r10));
+    mk_http_cookie_index_init(&idx, req);
+    check("c3 no cookies", test_cookie(&idx, "a", NULL));
+    free(req);
+
+    /* Test content negotiation */
+    unsigned int codings = MK_ACCEPT_BIT(MK_CODING_BR) |
+        MK_ACCEPT_BIT(MK_CODING_GZIP) | MK_ACCEPT_BIT(MK_CODING_IDENTITY);
+    unsigned int media = MK_ACCEPT_BIT(MK_MEDIA_HTML) |
+        MK_ACCEPT_BIT(MK_MEDIA_JSON);
+
+    check("a1 gzip", test_accept("Accept-Encoding: gzip, deflate\r\n",
+                                 codings) == MK_CODING_GZIP);
+    check("a2 br", test_accept("Accept-Encoding: gzip, deflate, br\r\n",
+                               codings) == MK_CODING_BR);
+    check("a3 q", test_accept("Accept-Encoding: br;q=0.5, GZIP;q=0.8\r\n",
+                              codings) == MK_CODING_GZIP);
+    check("a4 identity", test_accept("Accept-Encoding: zstd\r\n",
+                                     codings) == MK_CODING_IDENTITY);
+    check("a5 star", test_accept("Accept-Encoding: *;q=0, gzip;q=0\r\n",
+                                 codings) == -1);
+    check("a6 star", test_accept("Accept-Encoding: identity;q=0.1, *\r\n",
+                                 codings) == MK_CODING_BR);
+    check("a7 cached", test_accept("Accept-Encoding: gzip, deflate\r\n",
+                                   codings) == MK_CODING_GZIP);
+    check("a8 missing", test_accept("", codings) == MK_MEDIA_HTML);
+    check("a9 json", test_accept("Accept: application/json\r\n",
+                                 media) == MK_MEDIA_JSON);
+    check("a10 html", test_accept("Accept: text/html,application/xhtml+xml,"
+                                  "application/xml;q=0.9,*/*;q=0.8\r\n",
+                                  media) == MK_MEDIA_HTML);
+    check("a11 range", test_accept("Accept: text/*;q=0.2, "
+                                   "application/*;q=0.5\r\n",
+                                   media) == MK_MEDIA_JSON);
+    check("a12 none", test_accept("Accept: image/png, text/html;q=0\r\n",
+                                  media) == -1);
+    check("a13 bad q", test_accept("Accept: application/json;q=2, "
+                                   "text/html;q=0.001\r\n",
+                                   media) == MK_MEDIA_HTML);
+
+    /* Test request fingerprints */
+    char *f1 = "GET /a?b=1 HTTP/1.1\r\nHost: x\r\nUser-Agent: u\r\n"
+        "Accept-Encoding: gzip\r\n\r\n";
+    char *f2 = "GET /a?b=1 HTTP/1.0\r\nAccept-Encoding: br\r\n"
+        "Host: x\r\n\r\n";
+    char *f3 = "GET /a?b=2 HTTP/1.1\r\nHost: x\r\n\r\n";
+    char *f4 = "GET /a HTTP/1.1\r\nHost: x\r\n\r\n";
+    char *f5 = "HEAD /a?b=1 HTTP/1.1\r\nHost: x\r\n\r\n";
+    char *f6 = "GET /a?b=1 HTTP/1.1\r\nHost: y\r\n\r\n";
+    unsigned int fp_mask = MK_HTTP_FP_BIT(MK_HEADER_HOST) |
+        MK_HTTP_FP_BIT(MK_HEADER_ACCEPT_ENCODING);
+    uint64_t fp;
+
+    fp = test_fingerprint(f1, 0);
+    check("f1 fingerprint", fp != 0 && fp == test_fingerprint(f2, 0) &&
+          fp != test_fingerprint(f3, 0) && fp != test_fingerprint(f4, 0) &&
+          fp != test_fingerprint(f5, 0) && fp != test_fingerprint(f6, 0));
+    check("f2 vary", test_fingerprint(f1, fp_mask) !=
+          test_fingerprint(f2, fp_mask));
+
+    /* Test the micro-cache */
+    struct mk_http_microcache *cache;
+
+    cache = mk_http_microcache_create(100, 64);
+    check("mc1 create", cache && cache->slots == 128);
+    check("mc2 miss", mk_http_microcache_get(cache, fp, 10, out, 256) == -1);
+    check("mc3 put", mk_http_microcache_put(cache, fp, 20, "HTTP/1.1 200", 12)
+          == 0);
+    ret = mk_http_microcache_get(cache, fp, 10, out, 256);
+    check("mc4 hit", ret == 12 && strncmp(out, "HTTP/1.1 200", 12) == 0);
+    check("mc5 expired", mk_http_microcache_get(cache, fp, 20, out, 256) == -1);
+    check("mc6 other key", mk_http_microcache_get(cache, fp + 128, 10,
+                                                  out, 256) == -1);
+    check("mc7 too big", mk_http_microcache_put(cache, fp, 20, out, 65) == -1);
+    mk_http_microcache_destroy(cache);
+
+    /* Test PROXY protocol preambles */
+    char *p1 = "PROXY TCP4 192.168.0.1 10.0.0.1 56324 443\r\n"
+        "GET / HTTP/1.1\r\nHost: x\r\n\r\n";
+    char *p2 = "PROXY TCP6 ::1 2001:db8::2 1 80\r\nGET / HTTP/1.0\r\n\r\n";
+    char *p3 = "PROXY UNKNOWN ffff::1 ::1 1 2\r\nGET / HTTP/1.0\r\n\r\n";
+    char *p4 = "PROXY TCP4 192.168.0.1 10.0.0.1 56324\r\nGET / HTTP/1.0\r\n";
+    char *p5 = "PROXY TCP4 192.168.0.1 10.0.0.1 56324 443\r\n";
+    char *p6 = "GET / HTTP/1.0\r\n\r\n";
+    char p7[] = "\r\n\r\n\0\r\nQUIT\n" "\x21\x11\x00\x15"
+        "\x7f\x00\x00\x01" "\x0a\x00\x00\x02" "\x1f\x90" "\x00\x50"
+        "\x02\x00\x06" "a.test"
+        "GET / HTTP/1.1\r\nHost: a.test\r\n\r\n";
+    char p8[] = "\r\n\r\n\0\r\nQUIT\n" "\x20\x00\x00\x00"
+        "GET / HTTP/1.0\r\n\r\n";
+    char p9[] = "\r\n\r\n\0\r\nQUIT\n" "\x21\x11\x00\x04"
+        "\x7f\x00\x00\x01GET / HTTP/1.0\r\n\r\n";
+    struct mk_http_parser preq;
+    mk_ptr_t tlv;
+
+    ret = test_proxy(p1, strlen(p1), &preq);
+    check("p1 v1 tcp4", ret == MK_HTTP_OK && preq.proxy.version == 1 &&
+          preq.proxy.family == AF_INET && preq.proxy.src_addr[0] == 192 &&
+          preq.proxy.dst_addr[0] == 10 && preq.proxy.src_port == 56324 &&
+          preq.proxy.dst_port == 443 &&
+          preq.proxy.length == strstr(p1, "GET") - p1 &&
+          preq.headers[MK_HEADER_HOST].type == MK_HEADER_HOST);
+
+    ret = test_proxy(p2, strlen(p2), &preq);
+    check("p2 v1 tcp6", ret == MK_HTTP_OK && preq.proxy.family == AF_INET6 &&
+          preq.proxy.src_addr[15] == 1 && preq.proxy.dst_addr[0] == 0x20 &&
+          preq.proxy.dst_port == 80);
+
+    ret = test_proxy(p3, strlen(p3), &preq);
+    check("p3 v1 unknown", ret == MK_HTTP_OK &&
+          preq.proxy.family == AF_UNSPEC);
+
+    ret = test_proxy(p4, strlen(p4), &preq);
+    check("p4 v1 invalid", ret == MK_HTTP_ERROR);
+
+    ret = test_proxy(p5, strlen(p5), &preq);
+    check("p5 v1 pending", ret == MK_HTTP_PENDING);
+
+    ret = test_proxy(p6, strlen(p6), &preq);
+    check("p6 missing", ret == MK_HTTP_ERROR);
+
+    ret = test_proxy(p7, sizeof(p7) - 1, &preq);
+    check("p7 v2 inet", ret == MK_HTTP_OK && preq.proxy.version == 2 &&
+          preq.proxy.family == AF_INET && preq.proxy.src_addr[0] == 127 &&
+          preq.proxy.dst_addr[3] == 2 && preq.proxy.src_port == 8080 &&
+          preq.proxy.dst_port == 80 && preq.proxy.length == 37 &&
+          mk_http_proxy_tlv(&preq.proxy, MK_PROXY_TLV_AUTHORITY, &tlv) == 0 &&
+          tlv.len == 6 && strncmp(tlv.data, "a.test", 6) == 0 &&
+          mk_http_proxy_tlv(&preq.proxy, MK_PROXY_TLV_SSL, &tlv) == -1);
+
+    ret = test_proxy(p8, sizeof(p8) - 1, &preq);
+    check("p8 v2 local", ret == MK_HTTP_OK && preq.proxy.local == 1 &&
+          preq.proxy.family == AF_UNSPEC);
+
+    ret = test_proxy(p9, sizeof(p9) - 1, &preq);
+    check("p9 v2 short", ret == MK_HTTP_ERROR);
+
+    /* Test parsed request descriptors */
+    char *d1 = "POST /upload?id=7 HTTP/1.1\r\n"
+        "Host: example\r\n"
+        "User-Agent: test\r\n"
+        "Content-Length: 4\r\n\r\n"
+        "ABCD";
+    char ring[512];
+    char *raw;
+    uint64_t d_desc[64];
+    struct mk_http_desc *desc;
+    mk_ptr_t v;
+
+    req = mk_http_parser_new();
+    len = strlen(d1);
+    ret = mk_http_parser(req, d1, len - 2);
+    check("d1 partial", ret == MK_HTTP_PENDING &&
+          mk_http_desc_write(req, d1, d_desc, sizeof(d_desc)) == -1);
+    ret = mk_http_parser(req, d1, 2);
+    check("d1 small", ret == MK_HTTP_OK &&
+          mk_http_desc_write(req, d1, d_desc, 16) == -1);
+    ret = mk_http_desc_write(req, d1, d_desc, sizeof(d_desc));
+    check("d1 write", ret == mk_http_desc_size(req) && ret == 64 + 3 * 8);
+
+    /* hand off: raw bytes and descriptor are copied to another place */
+    memcpy(ring, d_desc, ret);
+    memcpy(ring + ret, d1, len);
+    free(req);
+
+    desc = (struct mk_http_desc *) ring;
+    raw  = ring + ret;
+    check("d1 check", mk_http_desc_check(desc, ret, len) == 0 &&
+          mk_http_desc_check(desc, ret, len - 1) == -1);
+    v = mk_http_desc_ptr(raw, &desc->uri);
+    check("d1 uri", v.len == 7 && strncmp(v.data, "/upload", 7) == 0);
+    v = mk_http_desc_ptr(raw, &desc->query_string);
+    check("d1 query", v.len == 4 && strncmp(v.data, "id=7", 4) == 0);
+    v = mk_http_desc_ptr(raw, &desc->body);
+    check("d1 body", v.len == 4 && strncmp(v.data, "ABCD", 4) == 0 &&
+          desc->length == len);
+    check("d1 headers",
+          mk_http_desc_header(desc, raw, MK_HEADER_USER_AGENT, &v) == 0 &&
+          v.len == 4 && strncmp(v.data, "test", 4) == 0 &&
+          mk_http_desc_header(desc, raw, MK_HEADER_HOST, &v) == 0 &&
+          v.len == 7 && strncmp(v.data, "example", 7) == 0 &&
+          mk_http_desc_header(desc, raw, MK_HEADER_COOKIE, &v) == -1);
+
+    desc->version++;
+    check("d1 version", mk_http_desc_check(desc, ret, len) == -1);
+
+    /* Test HTTP dates */
+    check("t1 imf-fixdate",
+          test_date("Sun, 06 Nov 1994 08:49:37 GMT") == 784111777);
+    check("t2 rfc850",
+          test_date("Sunday, 06-Nov-94 08:49:37 GMT") == 784111777);
+    check("t3 asctime", test_date("Sun Nov  6 08:49:37 1994") == 784111777);
+    check("t4 leap year", test_date("Tue, 29 Feb 2000 00:00:00 GMT") ==
+          951782400 && test_date("Sat, 01 Jan 2039 00:00:00 GMT") ==
+          2177452800LL && test_date("Thu, 01 Jan 1970 00:00:00 GMT") == 0);
+    check("t5 invalid",
+          test_date("Sun, 06 Nov 1994 08:49:37 UTC") == -1 &&
+          test_date("Sun, 06 Abc 1994 08:49:37 GMT") == -1 &&
+          test_date("Sun, 31 Nov 1994 08:49:37 GMT") == -1 &&
+          test_date("Mon, 29 Feb 1900 08:49:37 GMT") == -1 &&
+          test_date("Sun, 06 Nov 1994 24:49:37 GMT") == -1 &&
+          test_date("Sun Nov 6 08:49:37 1994") == -1 &&
+          test_date("1994") == -1);
+
+    char *t6 = "GET / HTTP/1.1\r\n"
+        "If-Modified-Since: Sun, 06 Nov 1994 08:49:37 GMT\r\n"
+        "Last-Modified: yesterday\r\n\r\n";
+    time_t t;
+
+    for (i = 0; i < 2; i++) {
+        req = mk_http_parser_new();
+        mk_http_parser(req, t6, strlen(t6));
+        check("t6 header", mk_http_header_date(req, MK_HEADER_IF_MODIFIED_SINCE,
+                                               &t) == 0 && t == 784111777 &&
+              mk_http_header_date(req, MK_HEADER_LAST_MODIFIED, &t) == -1 &&
+              mk_http_header_date(req, MK_HEADER_RANGE, &t) == -1);
+        free(req);
+    }
+
+    /* Test the response head builder */
+    char *w1 = "GET / HTTP/1.1\r\nX-Request-Id: abc-123\r\n\r\n";
+    struct mk_http_response resp;
+
+    req = mk_http_parser_new();
+    mk_http_parser(req, w1, strlen(w1));
+
+    mk_http_response_init(&resp);
+    mk_http_response_status(&resp, 304);
+    mk_http_response_date(&resp, 784111777);
+    mk_http_response_header(&resp, MK_HEADER_CONTENT_TYPE, "text/html", 9);
+    mk_http_response_content_length(&resp, 1024);
+    mk_http_response_line(&resp, "Server: Monkey\r\n", 16);
+    mk_http_response_echo(&resp, req, MK_HEADER_X_REQUEST_ID);
+    ret = mk_http_response_end(&resp);
+    test_response(&resp, out);
+    check("w1 head", ret == 13 && strcmp(out,
+          "HTTP/1.1 304 Not Modified\r\n"
+          "Date: Sun, 06 Nov 1994 08:49:37 GMT\r\n"
+          "Content-Type: text/html\r\n"
+          "Content-Length: 1024\r\n"
+          "Server: Monkey\r\n"
+          "X-Request-Id: abc-123\r\n\r\n") == 0);
+    free(req);
+
+    mk_http_response_init(&resp);
+    check("w2 status", mk_http_response_status(&resp, 299) == -1 &&
+          mk_http_response_status(&resp, 600) == -1 &&
+          mk_http_response_status(&resp, 100) == 0 &&
+          mk_http_response_content_length(&resp, 0) == 0);
+    mk_http_response_date(&resp, 0);
+    mk_http_response_end(&resp);
+    test_response(&resp, out);
+    check("w3 date", strcmp(out, "HTTP/1.1 100 Continue\r\n"
+                            "Content-Length: 0\r\n"
+                            "Date: Thu, 01 Jan 1970 00:00:00 GMT\r\n\r\n")
+          == 0);
+
+    /* Test the access log records */
+    int fds[2];
+    char lbuf[512];
+    struct mk_http_log *log;
+    char *l1 = "GET /a/b?x=1&y=2 HTTP/1.1\r\n"
+               "Host: monkey.io\r\n"
+               "User-Agent: curl/7.38.0\r\n"
+               "Referer: http://monkey.io/\r\n\r\n";
+    char *l2 = "POST /\"q\" HTTP/1.0\r\n"
+               "User-Agent: a\\b\x01\xc3\xa9 \"c\"\r\n\r\n";
+
+    pipe(fds);
+    log = mk_http_log_create(fds[1], MK_LOG_TEXT, 512);
+    ret = test_log(log, fds[0], l1, lbuf, sizeof(lbuf));
+    check("l1 text", ret > 0 && strcmp(lbuf,
+          "1416231513 \"monkey.io\" \"GET /a/b?x=1&y=2 HTTP/1.1\" 200 1024 "
+          "\"http://monkey.io/\" \"curl/7.38.0\"\n") == 0);
+
+    ret = test_log(log, fds[0], l2, lbuf, sizeof(lbuf));
+    check("l2 text escape", ret > 0 && strcmp(lbuf,
+          "1416231513 - \"POST /\\\"q\\\" HTTP/1.0\" 200 1024 - "
+          "\"a\\\\b\\x01\\xc3\\xa9 \\\"c\\\"\"\n") == 0);
+
+    /* Records wrapping at the ring end keep their bytes order */
+    for (i = 0; i < 6; i++) {
+        ret = test_log(log, fds[0], l1, lbuf, sizeof(lbuf));
+        if (ret != 94 || strncmp(lbuf, "1416231513 \"monkey.io\"", 22) != 0) {
+            break;
+        }
+    }
+    check("l3 wrap", i == 6 && log->used == 0 && log->dropped == 0);
+
+    /* a Host with spaces stays in its field, no request line is a "-" */
+    ret = test_log(log, fds[0], "GET / HTTP/1.1\r\nHost: a b\r\n\r\n",
+                   lbuf, sizeof(lbuf));
+    check("l7 host", ret > 0 && strcmp(lbuf,
+          "1416231513 \"a b\" \"GET / HTTP/1.1\" 200 1024 - -\n") == 0);
+
+    ret = test_log(log, fds[0], "\x16\x03\x01", lbuf, sizeof(lbuf));
+    check("l8 no request line", ret > 0 && strcmp(lbuf,
+          "1416231513 - - 200 1024 - -\n") == 0);
+    mk_http_log_destroy(log);
+
+    log = mk_http_log_create(fds[1], MK_LOG_JSON, 1024);
+    ret = test_log(log, fds[0], l1, lbuf, sizeof(lbuf));
+    check("l4 json", ret > 0 && strcmp(lbuf,
+          "{\"time\":1416231513,\"host\":\"monkey.io\",\"method\":\"GET\","
+          "\"uri\":\"/a/b\",\"query\":\"x=1&y=2\",\"protocol\":\"HTTP/1.1\","
+          "\"status\":200,\"bytes\":1024,\"referer\":\"http://monkey.io/\","
+          "\"user_agent\":\"curl/7.38.0\"}\n") == 0);
+
+    ret = test_log(log, fds[0], l2, lbuf, sizeof(lbuf));
+    check("l5 json escape", ret > 0 && strcmp(lbuf,
+          "{\"time\":1416231513,\"host\":null,\"method\":\"POST\","
+          "\"uri\":\"/\\\"q\\\"\",\"query\":null,\"protocol\":\"HTTP/1.0\","
+          "\"status\":200,\"bytes\":1024,\"referer\":null,"
+          "\"user_agent\":\"a\\\\b\\u0001\xc3\xa9 \\\"c\\\"\"}\n") == 0);
+
+    ret = test_log(log, fds[0], "\x16\x03\x01", lbuf, sizeof(lbuf));
+    check("l9 json no request line", ret > 0 && strcmp(lbuf,
+          "{\"time\":1416231513,\"host\":null,\"method\":null,"
+          "\"uri\":null,\"query\":null,\"protocol\":null,"
+          "\"status\":200,\"bytes\":1024,\"referer\":null,"
+          "\"user_agent\":null}\n") == 0);
+    mk_http_log_destroy(log);
+
+    /* A record bigger than the ring is dropped */
+    log = mk_http_log_create(fds[1], MK_LOG_TEXT, 256);
+    ret = test_log(log, fds[0], l1, lbuf, sizeof(lbuf));
+    check("l6 drop", ret == -1 && log->dropped == 1 && log->used == 0);
+    mk_http_log_destroy(log);
+    close(fds[0]);
+    close(fds[1]);
+
     printf("%s===> Tests Passed:%s %s%s%i/%i%s\n\n",
            ANSI_BOLD, ANSI_RESET,
            ANSI_BOLD,